@@ -0,0 +1,182 @@
+/**
+ * @file BranchCoupler.c
+ * @brief DS2409 MicroLAN coupler branches with a branch table per sensor slot
+ * @license MIT License
+ * @details Splits one 1-Wire pin into a trunk and switched branches, so every segment stays
+ * short enough for clean slots.
+ *
+ * Couplers (family 0x1F) are found by the search on the trunk with all lines off. Each
+ * coupler has two branches, main and auxiliary, which are numbered 1 + 2 * coupler + line;
+ * branch 0 (COUPLER_TRUNK) is the trunk itself. A discovery pass enumerates the trunk first
+ * and then every branch in turn, and records the branch of every newly found sensor in
+ * couplerSlotBranch[], indexed by sensor history slot like the scheduler entries.
+ *
+ * At most one branch is connected at a time. Trunk devices are reachable whatever branch
+ * is on, so they never cause a switch. SensorScheduler.c keeps the bus on the active branch
+ * until all due sensors there are converted and read, then moves on, so a branch is switched
+ * once per batch instead of once per transaction.
+ *
+ * Branch sensors must be externally powered: conversions keep running while their branch
+ * is switched off. Nested couplers are not supported. The number of sensors is still bound
+ * by SENSOR_HISTORY_SLOTS, i.e. by RAM, not by the bus.
+ *
+ * Needs the search engine (ONEWIRE_SEARCH). With ONEWIRE_COUPLER set to 0 (see
+ * OneWireConfig.h) the calls compile to nothing and every sensor is on the trunk.
+ *
+ * Single-file module, included by temp-sensors.c the same way OneWire.c is.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef COUPLER_MAX
+#define COUPLER_MAX 4                    // Couplers remembered, two branches each
+#endif
+
+#define COUPLER_FAMILY 0x1F
+#define COUPLER_TRUNK 0
+
+// DS2409 control commands, each answered by a confirmation byte equal to the command.
+#define COUPLER_CMD_ALL_LINES_OFF 0x66
+#define COUPLER_CMD_SMART_ON_MAIN 0xCC
+#define COUPLER_CMD_SMART_ON_AUX 0x33
+
+#if ONEWIRE_COUPLER
+
+#if !ONEWIRE_SEARCH
+#error "ONEWIRE_COUPLER needs ONEWIRE_SEARCH"
+#endif
+
+uint8_t couplerRoms[COUPLER_MAX][8];
+uint8_t couplerCount;
+uint8_t couplerActive = COUPLER_TRUNK;      // Branch currently connected
+uint8_t couplerSearchBranch = COUPLER_TRUNK; // Branch the discovery pass is enumerating
+uint8_t couplerSlotBranch[SENSOR_HISTORY_SLOTS];
+uint32_t couplerSwitches;                    // Branches switched on since start
+
+// Turn every branch of every coupler off. Skip ROM is fine, all couplers confirm with the same byte.
+static bool couplerAllLinesOff() {
+    if (!OneWireReset()) {
+        return false;
+    }
+    OneWireSkip();
+    OneWireWrite(COUPLER_CMD_ALL_LINES_OFF, 0);
+    return OneWireRead() == COUPLER_CMD_ALL_LINES_OFF;
+}
+
+/**
+ * @brief Start with all branches off.
+ */
+void CouplerBegin() {
+    couplerAllLinesOff();
+    couplerActive = COUPLER_TRUNK;
+}
+
+/**
+ * @brief Connect a branch, disconnecting the one that was on. Does nothing if it is already on.
+ * @param branch The branch, COUPLER_TRUNK to only disconnect.
+ * @return True if the branch is connected.
+ */
+bool CouplerSelect(uint8_t branch) {
+    if (branch == couplerActive) {
+        return true;
+    }
+    if (couplerActive != COUPLER_TRUNK) {
+        if (!couplerAllLinesOff()) {
+            return false;
+        }
+        couplerActive = COUPLER_TRUNK;
+    }
+    if (branch == COUPLER_TRUNK) {
+        return true;
+    }
+
+    uint8_t coupler = (branch - 1) >> 1;
+    uint8_t command = ((branch - 1) & 1) ? COUPLER_CMD_SMART_ON_AUX : COUPLER_CMD_SMART_ON_MAIN;
+    if (coupler >= couplerCount || !OneWireReset()) {
+        return false;
+    }
+    OneWireSelect(couplerRoms[coupler]);
+    OneWireWrite(command, 0);
+    OneWireRead();                       // Reset stimulus, the coupler resets the branch meanwhile
+    if (OneWireRead() != command) {
+        return false;
+    }
+    couplerActive = branch;
+    couplerSwitches++;
+    return true;
+}
+
+/**
+ * @brief Remember a coupler found on the trunk.
+ * @param rom The 8-byte address of the coupler.
+ * @return True if it is new and there was room for it.
+ */
+bool CouplerAdd(const uint8_t rom[8]) {
+    for (uint8_t i = 0; i < couplerCount; i++) {
+        if (memcmp(couplerRoms[i], rom, 8) == 0) {
+            return false;
+        }
+    }
+    if (couplerCount >= COUPLER_MAX) {
+        return false;
+    }
+    memcpy(couplerRoms[couplerCount++], rom, 8);
+    return true;
+}
+
+/**
+ * @brief Record the branch of a newly found sensor: the one being enumerated.
+ * @param slot The sensor history slot of the sensor.
+ */
+void CouplerAssign(int8_t slot) {
+    if (slot >= 0 && slot < SENSOR_HISTORY_SLOTS) {
+        couplerSlotBranch[slot] = couplerSearchBranch;
+    }
+}
+
+/**
+ * @brief The branch a sensor is on.
+ * @param slot The sensor history slot of the sensor.
+ */
+uint8_t CouplerBranchOf(int8_t slot) {
+    return couplerSlotBranch[slot];
+}
+
+/**
+ * @brief The branch that is currently connected.
+ */
+uint8_t CouplerActive() {
+    return couplerActive;
+}
+
+/**
+ * @brief Move the discovery pass on to the next branch and connect it.
+ * @return True if there is a branch left to search, false once the pass is complete,
+ * in which case all branches are off and the next pass starts on the trunk again.
+ * Branches that cannot be switched on are skipped.
+ */
+bool CouplerSearchNextBranch() {
+    while (couplerSearchBranch < 2 * couplerCount) {
+        couplerSearchBranch++;
+        if (CouplerSelect(couplerSearchBranch)) {
+            return true;
+        }
+    }
+    couplerSearchBranch = COUPLER_TRUNK;
+    CouplerSelect(COUPLER_TRUNK);
+    return false;
+}
+
+#else
+
+static inline void CouplerBegin() { }
+static inline bool CouplerSelect(uint8_t branch) { (void)branch; return true; }
+static inline bool CouplerAdd(const uint8_t rom[8]) { (void)rom; return false; }
+static inline void CouplerAssign(int8_t slot) { (void)slot; }
+static inline uint8_t CouplerBranchOf(int8_t slot) { (void)slot; return COUPLER_TRUNK; }
+static inline uint8_t CouplerActive() { return COUPLER_TRUNK; }
+static inline bool CouplerSearchNextBranch() { return false; }
+
+#endif
@@ -0,0 +1,287 @@
+/**
+ * @file BusPlanner.c
+ * @brief Sweep time prediction and bus budget planning from the driver's slot timings
+ * @license MIT License
+ * @details Computes how long the bus is busy for each transaction the firmware does, from
+ * the ONEWIRE_T_* slot timings in OneWire_Timing.h and the actual bits on the wire (a
+ * write 0 slot is longer than a write 1 slot, so the ROM matters), and from that how long
+ * a sweep over a device table takes and how often each sensor can be sampled.
+ *
+ * A sweep is modelled the way SensorScheduler.c runs it:
+ *  - PLAN_CONVERT_EACH with overlap: conversions are started one after the other and
+ *    every finished conversion is read before the next one is started (ONEWIRE_ASYNC).
+ *  - PLAN_CONVERT_EACH without overlap, or on parasite power: convert, wait, read, one
+ *    sensor at a time.
+ *  - PLAN_CONVERT_BROADCAST: one Skip ROM conversion, then the reads (ONEWIRE_LOWPOWER).
+ *
+ * Bus times are for the bit-bang driver, the only backend there is; they leave out the few
+ * instructions between slots.
+ *
+ * On target, with ONEWIRE_PLANNER set to 1 (see OneWireConfig.h), every addressed conversion
+ * is timed with SysTick and compared with its prediction. A bus that keeps running over its
+ * plan points at slow edges, i.e. degraded wiring, or at interrupts stealing slot time.
+ *
+ * The planner itself has no hardware dependencies: tools/bus_planner.c builds it on the host
+ * with ONEWIRE_PLANNER set to 0.
+ *
+ * Single-file module, included by temp-sensors.c the same way OneWire.c is.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "OneWire_Timing.h"
+
+#define PLAN_POWER_EXTERNAL 0            // Sensors on their own supply
+#define PLAN_POWER_PARASITE 1            // Bus held high through every conversion, nothing overlaps
+
+#define PLAN_CONVERT_EACH 0              // One addressed conversion per sensor
+#define PLAN_CONVERT_BROADCAST 1         // One Skip ROM conversion per sweep
+
+#define PLAN_FLAG_TOO_SLOW 0x01          // A sweep takes longer than the requested period
+#define PLAN_FLAG_BUS_OVERLOAD 0x02      // The transactions alone take longer than the period
+#define PLAN_FLAG_TOO_MANY 0x04          // More sensors than the firmware has slots for
+
+#ifndef PLAN_TOLERANCE_PCT
+#define PLAN_TOLERANCE_PCT 10            // Measured bus time allowed over the prediction
+#endif
+
+typedef struct {
+    uint8_t rom[8];
+    uint8_t resolution;                  // 9..12 bits; the DS18S20 always converts for 750 ms
+    uint32_t sampleUs;                   // Filled in by PlanSweep(): when its reading completes
+    uint32_t startUs;                    // Used by PlanSweep()
+    bool started;
+    bool done;
+} PlanDevice;
+
+typedef struct {
+    uint8_t power;                       // PLAN_POWER_*
+    uint8_t convert;                     // PLAN_CONVERT_*
+    bool overlap;                        // Conversions overlap (ONEWIRE_ASYNC)
+    bool fastRead;                       // Two byte scratchpad reads instead of nine
+    uint32_t periodMs;                   // Requested sample period, 0 for as fast as possible
+    uint16_t maxSensors;                 // Sensor slots in the firmware, 0 for no limit
+} PlanConfig;
+
+typedef struct {
+    uint32_t busUs;                      // Time the bus is busy in one sweep
+    uint32_t sweepUs;                    // One reading from every sensor
+    uint32_t rateMilliHz;                // Samples per sensor per 1000 s, at back to back sweeps
+    uint8_t flags;                       // PLAN_FLAG_*
+} PlanResult;
+
+#define PLAN_WRITE1_US (ONEWIRE_T_WRITE1_LOW + ONEWIRE_T_WRITE1_RECOVERY)
+#define PLAN_WRITE0_US (ONEWIRE_T_WRITE0_LOW + ONEWIRE_T_WRITE0_RECOVERY)
+#define PLAN_READ_US (ONEWIRE_T_READ_LOW + ONEWIRE_T_READ_SAMPLE + ONEWIRE_T_READ_RECOVERY)
+
+/**
+ * @brief Bus time of a reset, including the first idle check.
+ */
+uint32_t PlanResetUs() {
+    return 2 + ONEWIRE_T_RESET_LOW + ONEWIRE_T_PRESENCE_SAMPLE + ONEWIRE_T_RESET_RECOVERY;
+}
+
+/**
+ * @brief Bus time of writing one byte.
+ * @param v The byte, its ones and zeros take different slot times.
+ */
+uint32_t PlanWriteUs(uint8_t v) {
+    uint32_t us = 0;
+    for (uint8_t mask = 1; mask; mask <<= 1) {
+        us += (v & mask) ? PLAN_WRITE1_US : PLAN_WRITE0_US;
+    }
+    return us;
+}
+
+/**
+ * @brief Bus time of reading bytes.
+ * @param count The number of bytes.
+ */
+uint32_t PlanReadUs(uint16_t count) {
+    return (uint32_t)count * 8 * PLAN_READ_US;
+}
+
+/**
+ * @brief Bus time of Match ROM with a device's address.
+ * @param rom The 8-byte address.
+ */
+uint32_t PlanSelectUs(const uint8_t rom[8]) {
+    uint32_t us = PlanWriteUs(0x55);
+    for (uint8_t i = 0; i < 8; i++) {
+        us += PlanWriteUs(rom[i]);
+    }
+    return us;
+}
+
+/**
+ * @brief Bus time of starting a conversion on one sensor.
+ * @param rom The 8-byte address of the sensor.
+ */
+uint32_t PlanConvertUs(const uint8_t rom[8]) {
+    return PlanResetUs() + PlanSelectUs(rom) + PlanWriteUs(0x44);
+}
+
+/**
+ * @brief Bus time of a broadcast conversion.
+ */
+uint32_t PlanBroadcastUs() {
+    return PlanResetUs() + PlanWriteUs(0xCC) + PlanWriteUs(0x44);
+}
+
+/**
+ * @brief Bus time of reading a sensor's scratchpad.
+ * @param rom The 8-byte address of the sensor.
+ * @param fast True for the two byte read that is cut short with a reset.
+ */
+uint32_t PlanScratchpadUs(const uint8_t rom[8], bool fast) {
+    uint32_t us = PlanResetUs() + PlanSelectUs(rom) + PlanWriteUs(0xBE);
+    return fast ? us + PlanReadUs(2) + PlanResetUs() : us + PlanReadUs(9);
+}
+
+/**
+ * @brief Conversion time of a sensor, as the firmware schedules it.
+ * @param d The sensor.
+ * @return The conversion time in milliseconds.
+ */
+uint32_t PlanConversionMs(const PlanDevice *d) {
+    if (d->rom[0] == 0x10 || d->resolution < 9 || d->resolution > 12) {
+        return 750;
+    }
+    return 94u << (d->resolution - 9);
+}
+
+/**
+ * @brief Predict a sweep over a device table.
+ * @param devices The sensors, their sampleUs is filled in.
+ * @param n The number of sensors.
+ * @param cfg Power mode, conversion mode and the requested period.
+ * @param result Receives the bus budget, the sweep time and the flags.
+ */
+void PlanSweep(PlanDevice *devices, uint16_t n, const PlanConfig *cfg, PlanResult *result) {
+    uint32_t t = 0;
+    uint32_t bus = 0;
+    bool broadcast = cfg->convert == PLAN_CONVERT_BROADCAST;
+
+    for (uint16_t i = 0; i < n; i++) {
+        devices[i].started = broadcast;
+        devices[i].done = false;
+    }
+    if (broadcast) {
+        t = bus = PlanBroadcastUs();
+        for (uint16_t i = 0; i < n; i++) {
+            devices[i].startUs = t;
+        }
+    }
+
+    if (!broadcast && (!cfg->overlap || cfg->power == PLAN_POWER_PARASITE)) {
+        // One sensor at a time: convert, wait, read.
+        for (uint16_t i = 0; i < n; i++) {
+            PlanDevice *d = &devices[i];
+            uint32_t convert = PlanConvertUs(d->rom);
+            uint32_t read = PlanScratchpadUs(d->rom, cfg->fastRead);
+            bus += convert + read;
+            t += convert + PlanConversionMs(d) * 1000 + read;
+            d->sampleUs = t;
+            d->done = true;
+        }
+    } else {
+        // Finished conversions are read first, otherwise the next conversion starts,
+        // otherwise the bus waits for the next conversion to finish.
+        uint16_t next = 0;
+        uint16_t left = n;
+        while (left) {
+            int32_t best = -1;
+            uint32_t bestReady = 0;
+            uint32_t soonest = UINT32_MAX;
+            for (uint16_t i = 0; i < n; i++) {
+                PlanDevice *d = &devices[i];
+                if (!d->started || d->done) {
+                    continue;
+                }
+                uint32_t ready = d->startUs + PlanConversionMs(d) * 1000;
+                if (ready <= t && (best < 0 || ready < bestReady)) {
+                    best = i;
+                    bestReady = ready;
+                }
+                if (ready < soonest) {
+                    soonest = ready;
+                }
+            }
+            if (best >= 0) {
+                uint32_t read = PlanScratchpadUs(devices[best].rom, cfg->fastRead);
+                bus += read;
+                t += read;
+                devices[best].sampleUs = t;
+                devices[best].done = true;
+                left--;
+            } else if (!broadcast && next < n) {
+                uint32_t convert = PlanConvertUs(devices[next].rom);
+                devices[next].startUs = t;
+                devices[next].started = true;
+                next++;
+                bus += convert;
+                t += convert;
+            } else {
+                t = soonest;
+            }
+        }
+    }
+
+    result->busUs = bus;
+    result->sweepUs = t;
+    result->rateMilliHz = t ? 1000000000u / t : 0;
+    result->flags = 0;
+    if (cfg->periodMs && t > cfg->periodMs * 1000) result->flags |= PLAN_FLAG_TOO_SLOW;
+    if (cfg->periodMs && bus > cfg->periodMs * 1000) result->flags |= PLAN_FLAG_BUS_OVERLOAD;
+    if (cfg->maxSensors && n > cfg->maxSensors) result->flags |= PLAN_FLAG_TOO_MANY;
+}
+
+/**
+ * @brief Compare a measured transaction with its prediction.
+ * @param measuredUs The bus time measured with SysTick.
+ * @param plannedUs The prediction.
+ * @return True if the measurement is more than PLAN_TOLERANCE_PCT over the prediction.
+ */
+bool PlanCheck(uint32_t measuredUs, uint32_t plannedUs) {
+    return measuredUs * 100 > plannedUs * (100 + PLAN_TOLERANCE_PCT);
+}
+
+#if ONEWIRE_PLANNER
+
+uint32_t planChecks;                     // Conversions timed since start
+uint32_t planOverruns;                   // Of those, more than PLAN_TOLERANCE_PCT over the plan
+uint32_t planWorstExcessUs;              // Largest overrun seen
+
+/**
+ * @brief Check a timed conversion against the plan and log a new worst overrun.
+ * @param rom The 8-byte address of the sensor.
+ * @param ticks The SysTick ticks the conversion command took.
+ */
+void PlanObserveConvert(const uint8_t rom[8], uint32_t ticks) {
+    uint32_t measured = ticks / DELAY_US_TIME;
+    uint32_t planned = PlanConvertUs(rom);
+
+    planChecks++;
+    if (!PlanCheck(measured, planned)) {
+        return;
+    }
+    planOverruns++;
+    if (measured - planned > planWorstExcessUs) {
+        planWorstExcessUs = measured - planned;
+        LogPuts("Bus slower than planned: ");
+        LogPutU32(measured);
+        LogPuts("us instead of ");
+        LogPutU32(planned);
+        LogPuts("us, ");
+        LogPutU32(planOverruns);
+        LogPuts(" of ");
+        LogPutU32(planChecks);
+        LogPuts(" conversions over\n");
+    }
+}
+
+#else
+
+static inline void PlanObserveConvert(const uint8_t rom[8], uint32_t ticks) { (void)rom; (void)ticks; }
+
+#endif
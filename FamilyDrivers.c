@@ -0,0 +1,177 @@
+/**
+ * @file FamilyDrivers.c
+ * @brief Family code dispatch table of 1-Wire device drivers
+ * @license MIT License
+ * @details Every device the firmware services has a driver, found by the family code in
+ * the first ROM byte. A driver optionally starts a conversion and reads the result into
+ * one 16-bit value, so all families share the scheduler, the register map and the state
+ * machine in temp-sensors.c.
+ *
+ *   0x10 0x28 0x22  DS18S20, DS18B20, DS1822  temperature, Q4 (driver in temp-sensors.c)
+ *   0x26            DS2438 battery monitor    temperature, Q4
+ *   0x29            DS2408 8 channel PIO      PIO logic state, one bit per channel
+ *   0x2D            DS2431 1 kbit EEPROM      16-bit word at DS2431_VALUE_ADDRESS, little endian
+ *
+ * Reads are single bursts with the device's own check: the DS2408 PIO registers are read
+ * with their CRC16, the DS2438 page with its CRC8. The DS2431 Read Memory command has no
+ * CRC, so its word is read twice and the copies compared.
+ *
+ * Values with DRIVER_TEMPERATURE are Q4 temperatures; they go through the sensor history
+ * and its median filter. Other values go to the register map only.
+ *
+ * With ONEWIRE_FAMILIES set to 0 (see OneWireConfig.h) only the DS18x20 drivers are built.
+ *
+ * Single-file module, included by temp-sensors.c the same way OneWire.c is.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define DRIVER_TEMPERATURE 0x01          // The value is a Q4 temperature
+
+typedef struct {
+    uint8_t family;
+    uint8_t flags;                       // DRIVER_*
+    const char *name;
+    // Start a conversion, NULL if the device has nothing to convert.
+    void (*convert)(uint8_t rom[8]);
+    // Read the device. Returns false on a failed check, otherwise the value and how long
+    // the next conversion will take.
+    bool (*read)(int8_t slot, uint8_t rom[8], int16_t *value, uint16_t *conversionMs);
+} FamilyDriver;
+
+// The DS18x20 driver lives in temp-sensors.c with the rest of the temperature code.
+void sendTemperatureRequest(uint8_t address[8]);
+bool ds18x20Read(int8_t slot, uint8_t rom[8], int16_t *value, uint16_t *conversionMs);
+
+#if ONEWIRE_FAMILIES
+
+#if !ONEWIRE_CRC16 || !ONEWIRE_BYTE_HELPERS
+#error "ONEWIRE_FAMILIES needs ONEWIRE_CRC16 and ONEWIRE_BYTE_HELPERS"
+#endif
+
+#define DS2438_CONVERSION_MS 10
+
+#ifndef DS2431_VALUE_ADDRESS             // EEPROM address of the word a DS2431 publishes
+#define DS2431_VALUE_ADDRESS 0x0000
+#endif
+
+_Static_assert(DS2431_VALUE_ADDRESS < 0x7F, "The DS2431 word must lie in its 128 byte memory");
+
+static void ds2438Convert(uint8_t rom[8]) {
+    OneWireReset();
+    OneWireSelect(rom);
+    OneWireWrite(0x44, 0);               // Convert T
+}
+
+static bool ds2438Read(int8_t slot, uint8_t rom[8], int16_t *value, uint16_t *conversionMs) {
+    (void)slot;
+    uint8_t page[9];
+
+    OneWireReset();
+    OneWireSelect(rom);
+    OneWireWrite(0xB8, 0);               // Recall Memory, page 0 to the scratchpad
+    OneWireWrite(0x00, 0);
+    OneWireReset();
+    OneWireSelect(rom);
+    OneWireWrite(0xBE, 0);               // Read Scratchpad, page 0
+    OneWireWrite(0x00, 0);
+    OneWireReadBytes(page, sizeof(page));
+    if (OneWireCrc8(page, 8) != page[8]) {
+        return false;
+    }
+    // Bytes 1 and 2 hold the temperature in 1/256 C, the low 3 bits unused.
+    *value = (int16_t)((page[2] << 8) | page[1]) >> 4;
+    *conversionMs = DS2438_CONVERSION_MS;
+    return true;
+}
+
+static bool ds2408Read(int8_t slot, uint8_t rom[8], int16_t *value, uint16_t *conversionMs) {
+    (void)slot;
+    // Command, address, 8 register bytes, then the CRC16 over all of them.
+    uint8_t buf[13] = { 0xF0, 0x88, 0x00 };  // Read PIO Registers from 0x0088
+
+    OneWireReset();
+    OneWireSelect(rom);
+    OneWireWriteBytes(buf, 3, false);
+    OneWireReadBytes(buf + 3, 10);
+    OneWireReset();                      // End the read, the device would go on to 0x008F
+    if (!OneWireCheckCrc16(buf, 11, &buf[11], 0)) {
+        return false;
+    }
+    *value = buf[3];                     // PIO Logic State
+    *conversionMs = 0;
+    return true;
+}
+
+// Read the published DS2431 word in a single burst.
+static void ds2431ReadWord(uint8_t rom[8], uint8_t word[2]) {
+    static const uint8_t cmd[3] = { 0xF0, DS2431_VALUE_ADDRESS, 0x00 };  // Read Memory
+
+    OneWireReset();
+    OneWireSelect(rom);
+    OneWireWriteBytes(cmd, 3, false);
+    OneWireReadBytes(word, 2);
+    OneWireReset();                      // End the read, the device would go on to the end of memory
+}
+
+static bool ds2431Read(int8_t slot, uint8_t rom[8], int16_t *value, uint16_t *conversionMs) {
+    (void)slot;
+    uint8_t word[2];
+    uint8_t check[2];
+
+    ds2431ReadWord(rom, word);
+    ds2431ReadWord(rom, check);
+    if (memcmp(word, check, 2) != 0) {
+        return false;
+    }
+    *value = (int16_t)((word[1] << 8) | word[0]);
+    *conversionMs = 0;
+    return true;
+}
+
+#endif
+
+static const FamilyDriver familyDrivers[] = {
+    { 0x28, DRIVER_TEMPERATURE, "DS18B20", sendTemperatureRequest, ds18x20Read },
+    { 0x10, DRIVER_TEMPERATURE, "DS18S20", sendTemperatureRequest, ds18x20Read },  // or old DS1820
+    { 0x22, DRIVER_TEMPERATURE, "DS1822", sendTemperatureRequest, ds18x20Read },
+#if ONEWIRE_FAMILIES
+    { 0x26, DRIVER_TEMPERATURE, "DS2438", ds2438Convert, ds2438Read },
+    { 0x29, 0, "DS2408", NULL, ds2408Read },
+    { 0x2D, 0, "DS2431", NULL, ds2431Read },
+#endif
+};
+
+#define FAMILY_DRIVER_COUNT (sizeof(familyDrivers) / sizeof(familyDrivers[0]))
+
+/**
+ * @brief Look up the driver of a device.
+ * @param family The family code, the first ROM byte.
+ * @return The driver, or NULL if the family is not supported.
+ */
+const FamilyDriver *FamilyDriverFind(uint8_t family) {
+    for (uint8_t i = 0; i < FAMILY_DRIVER_COUNT; i++) {
+        if (familyDrivers[i].family == family) {
+            return &familyDrivers[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Family codes a discovery pass targets, one after the other.
+ * @param index 0 for the first family.
+ * @return The family code, or 0 past the last one. Couplers are included when
+ * ONEWIRE_COUPLER is set, so they are found on the trunk.
+ */
+uint8_t FamilySearchCode(uint8_t index) {
+    if (index < FAMILY_DRIVER_COUNT) {
+        return familyDrivers[index].family;
+    }
+    if (ONEWIRE_COUPLER && index == FAMILY_DRIVER_COUNT) {
+        return COUPLER_FAMILY;
+    }
+    return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * @file LogOutput.c
+ * @brief Non-blocking log output over USART1 TX DMA
+ * @license MIT License
+ * @details Replaces printf on the debug channel with a fixed-size ring buffer that is
+ * drained by DMA1 channel 4 into USART1 (TX on PD5).
+ *
+ * Log calls only copy bytes into RAM, they never wait on the UART. Text is staged into a
+ * line buffer and committed to the ring when a newline is written, so a line either goes
+ * out whole or is dropped whole. Dropped lines are counted and reported once there is room
+ * again. LogService() must be called from the main loop to start the next DMA transfer.
+ *
+ * Single-file module, included by temp-sensors.c the same way OneWire.c is.
+ */
+
+#include "ch32v003fun.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef LOG_BAUD
+#define LOG_BAUD 115200
+#endif
+
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 128              // Must be a power of two
+#endif
+
+#ifndef LOG_LINE_SIZE                    // Longest line that can be staged, longer ones go out in pieces
+#if LOG_BUFFER_SIZE >= 128
+#define LOG_LINE_SIZE 72
+#else
+#define LOG_LINE_SIZE (LOG_BUFFER_SIZE / 2) // Small profiles, see OneWireConfig.h
+#endif
+#endif
+
+#if (LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1)) != 0
+#error "LOG_BUFFER_SIZE must be a power of two"
+#endif
+
+_Static_assert(LOG_BUFFER_SIZE >= LOG_LINE_SIZE, "A staged line must fit the ring, or it is always dropped");
+_Static_assert(LOG_LINE_SIZE <= 255, "Staged line length is a uint8_t");
+
+char logBuffer[LOG_BUFFER_SIZE];
+volatile uint16_t logHead;               // Free running write index
+volatile uint16_t logTail;               // Free running index of the first unsent byte
+uint16_t logInFlight;                    // Bytes handed to the DMA, not yet released
+
+char logLine[LOG_LINE_SIZE];
+uint8_t logLineLength;
+
+uint32_t logDropped;                     // Lines lost because the ring was full, since startup
+uint32_t logDropReported;                // Value of logDropped last written to the log
+
+/**
+ * @brief Set up USART1 and its TX DMA channel for log output.
+ */
+void LogBegin() {
+    RCC->APB2PCENR |= RCC_APB2Periph_GPIOD | RCC_APB2Periph_USART1;
+    RCC->AHBPCENR |= RCC_AHBPeriph_DMA1;
+
+    // PD5 as alternate function push-pull, USART1 TX.
+    GPIOD->CFGLR &= ~(0xf << (4 * 5));
+    GPIOD->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP_AF) << (4 * 5);
+
+    USART1->BRR = (FUNCONF_SYSTEM_CORE_CLOCK + LOG_BAUD / 2) / LOG_BAUD;
+    USART1->CTLR1 = USART_CTLR1_TE;
+    USART1->CTLR3 = USART_CTLR3_DMAT;
+    USART1->CTLR1 |= USART_CTLR1_UE;
+
+    DMA1_Channel4->PADDR = (uint32_t)&USART1->DATAR;
+    DMA1_Channel4->CFGR = DMA_DIR_PeripheralDST | DMA_MemoryInc_Enable | DMA_Priority_Low;
+
+    logHead = logTail = 0;
+    logInFlight = 0;
+    logLineLength = 0;
+}
+
+// Copy a finished line into the ring, or drop it whole if it does not fit.
+static void logCommit(const char *buf, uint8_t len) {
+    uint16_t free = LOG_BUFFER_SIZE - (uint16_t)(logHead - logTail);
+    if (len > free) {
+        logDropped++;
+        return;
+    }
+    for (uint8_t i = 0; i < len; i++) {
+        logBuffer[(logHead + i) & (LOG_BUFFER_SIZE - 1)] = buf[i];
+    }
+    logHead += len;
+}
+
+/**
+ * @brief Free space in the ring buffer.
+ * @return The number of bytes that can be committed without dropping.
+ */
+uint16_t LogFree() {
+    return LOG_BUFFER_SIZE - (uint16_t)(logHead - logTail);
+}
+
+/**
+ * @brief True once everything logged has left the UART, e.g. before the clocks stop.
+ */
+bool LogIdle() {
+    return logHead == logTail && (USART1->STATR & USART_STATR_TC);
+}
+
+/**
+ * @brief Drain the ring buffer. Never waits on the UART.
+ * Call this regularly from the main loop.
+ */
+void LogService() {
+    if (logInFlight) {
+        if (DMA1_Channel4->CNTR != 0) {
+            return; // Still sending.
+        }
+        DMA1_Channel4->CFGR &= ~DMA_CFGR1_EN;
+        logTail += logInFlight;
+        logInFlight = 0;
+    }
+
+    if (logDropped != logDropReported) {
+        // Report lost lines once, as soon as the marker fits.
+        static const char text[] = " lines dropped\n";
+        char marker[1 + 10 + sizeof(text) - 1];  // '!', up to 10 digits, the text
+        uint8_t len = 0;
+        uint32_t n = logDropped - logDropReported;
+        char digits[10];
+        uint8_t d = 0;
+        do {
+            digits[d++] = '0' + n % 10;
+            n /= 10;
+        } while (n);
+        marker[len++] = '!';
+        while (d) marker[len++] = digits[--d];
+        for (const char *t = text; *t; t++) marker[len++] = *t;
+
+        if (LOG_BUFFER_SIZE - (uint16_t)(logHead - logTail) >= len) {
+            logCommit(marker, len);
+            logDropReported = logDropped;
+        }
+    }
+
+    uint16_t pending = logHead - logTail;
+    if (pending == 0) {
+        return;
+    }
+    uint16_t start = logTail & (LOG_BUFFER_SIZE - 1);
+    uint16_t contiguous = LOG_BUFFER_SIZE - start;
+    logInFlight = (pending < contiguous) ? pending : contiguous;
+
+    DMA1_Channel4->MADDR = (uint32_t)&logBuffer[start];
+    DMA1_Channel4->CNTR = logInFlight;
+    DMA1_Channel4->CFGR |= DMA_CFGR1_EN;
+}
+
+/**
+ * @brief Write one character. A newline commits the staged line.
+ * @param c The character.
+ */
+void LogPutc(char c) {
+    logLine[logLineLength++] = c;
+    if (c == '\n' || logLineLength == LOG_LINE_SIZE) {
+        logCommit(logLine, logLineLength);
+        logLineLength = 0;
+    }
+}
+
+/**
+ * @brief Write a string.
+ * @param s The NUL terminated string.
+ */
+void LogPuts(const char *s) {
+    while (*s) {
+        LogPutc(*s++);
+    }
+}
+
+/**
+ * @brief Write an unsigned number in decimal.
+ * @param v The number.
+ */
+void LogPutU32(uint32_t v) {
+    char digits[10];
+    uint8_t n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) {
+        LogPutc(digits[--n]);
+    }
+}
+
+/**
+ * @brief Write a signed number in decimal.
+ * @param v The number.
+ */
+void LogPutI32(int32_t v) {
+    if (v < 0) {
+        LogPutc('-');
+        LogPutU32(-(uint32_t)v);
+    } else {
+        LogPutU32(v);
+    }
+}
+
+/**
+ * @brief Write a byte as two upper case hex digits.
+ * @param v The byte.
+ */
+void LogPutHex8(uint8_t v) {
+    static const char hex[] = "0123456789ABCDEF";
+    LogPutc(hex[v >> 4]);
+    LogPutc(hex[v & 0x0F]);
+}
+
+/**
+ * @brief Write a Q4 fixed point value (1/16 per count) with two decimals.
+ * @param q4 The value.
+ */
+void LogPutQ4(int16_t q4) {
+    int32_t v = q4;
+    if (v < 0) {
+        LogPutc('-');
+        v = -v;
+    }
+    uint32_t hundredths = ((v & 0x0F) * 100 + 8) / 16;
+    uint32_t whole = (v >> 4) + hundredths / 100;
+    hundredths %= 100;
+    LogPutU32(whole);
+    LogPutc('.');
+    LogPutc('0' + hundredths / 10);
+    LogPutc('0' + hundredths % 10);
+}
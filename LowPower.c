@@ -0,0 +1,198 @@
+/**
+ * @file LowPower.c
+ * @brief Standby between sweeps with auto-wakeup, and an energy estimate per sweep
+ * @license MIT License
+ * @details For battery nodes. With ONEWIRE_LOWPOWER set to 1 (see OneWireConfig.h) a sweep
+ * starts with a broadcast conversion (Skip ROM, Convert T), the MCU goes to standby with
+ * the auto-wakeup timer set to the conversion time, wakes to read the sensors and goes back
+ * to standby until the next sweep is due.
+ *
+ * The auto-wakeup timer runs from the 128 kHz LSI. One standby lasts at most 63 ticks of
+ * the largest prescaler, about two seconds, so longer waits are several standbys in a row.
+ * SysTick does not count in standby. Its registers are saved before standby and written
+ * back after the clocks are set up again, so the counter resumes where it stopped, and the
+ * caller advances its millisecond clock by the time slept.
+ *
+ * A host simulator defines ONEWIRE_LOWPOWER to 1 and LOWPOWER_SLEEP(ms), returning the
+ * milliseconds its clock moved on, provides LogPuts() and LogPutU32(), and includes this
+ * file. The MCU headers and the AWU code are then left out, so sweep timing and the energy
+ * estimate can be checked without hardware.
+ *
+ * In standby the UART, the I2C slave and the hot-plug interrupt are stopped too: the log is
+ * drained before sleeping, and a host reading the register map has to tolerate a sleeping
+ * node.
+ *
+ * Energy is estimated from the time spent awake, asleep and converting, with the currents
+ * below. Adjust them to the board.
+ *
+ * Single-file module, included by temp-sensors.c the same way OneWire.c is.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#ifndef LOWPOWER_SLEEP
+#include "ch32v003fun.h"
+#endif
+
+#ifndef LOWPOWER_MIN_SLEEP_MS
+#define LOWPOWER_MIN_SLEEP_MS 20         // Shorter waits are not worth the wakeup
+#endif
+
+#ifndef LOWPOWER_MAX_SLEEP_MS
+#define LOWPOWER_MAX_SLEEP_MS 10000      // Longest sleep, so discovery still gets its turn
+#endif
+
+#ifndef LOWPOWER_SUPPLY_MV
+#define LOWPOWER_SUPPLY_MV 3300
+#endif
+
+#ifndef LOWPOWER_RUN_UA
+#define LOWPOWER_RUN_UA 3000             // MCU running from HSE with the peripherals on
+#endif
+
+#ifndef LOWPOWER_STANDBY_UA
+#define LOWPOWER_STANDBY_UA 10           // MCU in standby with the LSI and AWU running
+#endif
+
+#ifndef LOWPOWER_CONVERT_UA
+#define LOWPOWER_CONVERT_UA 1000         // One DS18B20 converting
+#endif
+
+#define LOWPOWER_LSI_KHZ 128
+#define LOWPOWER_AWU_MAX_TICKS 63        // AWUWR is 6 bits
+#define LOWPOWER_AWU_MAX_SHIFT 12        // Largest power of two prescaler, 4096
+
+#if ONEWIRE_LOWPOWER
+
+#ifndef LOWPOWER_SLEEP
+#define LOWPOWER_HARDWARE
+
+// One standby with the AWU set as close to 'ms' as its resolution allows, never longer.
+// Returns the milliseconds slept.
+static uint32_t lowPowerStandby(uint32_t ms) {
+    // Finest prescaler that still covers the wait in 63 ticks.
+    uint8_t shift = 1;
+    while (shift < LOWPOWER_AWU_MAX_SHIFT && ((ms * LOWPOWER_LSI_KHZ) >> shift) > LOWPOWER_AWU_MAX_TICKS) {
+        shift++;
+    }
+    uint32_t ticks = (ms * LOWPOWER_LSI_KHZ) >> shift;
+    if (ticks > LOWPOWER_AWU_MAX_TICKS) ticks = LOWPOWER_AWU_MAX_TICKS;
+    if (ticks == 0) {
+        return 0;
+    }
+
+    // SystemInit() below sets SysTick up again and may clear its counter or compare value.
+    uint32_t sysTickCtlr = SysTick->CTLR;
+    uint32_t sysTickCount = SysTick->CNT;
+    uint32_t sysTickCmp = SysTick->CMP;
+
+    PWR->AWUPSC = shift + 1;             // PWR_AWU_Prescaler_2 is 2, doubling per step
+    PWR->AWUWR = ticks;
+    PWR->AWUCSR |= PWR_AWUCSR_AWUEN;
+    PWR->CTLR |= PWR_CTLR_PDDS;
+    PFIC->SCTLR |= 1 << 2;               // SLEEPDEEP
+    __WFE();
+    PFIC->SCTLR &= ~(1 << 2);
+    SystemInit();                        // Wakeup runs from the HSI, back to the configured clock
+
+    // Put SysTick back as it was when the clocks stopped. The counter then resumes from the
+    // value millis() last saw, so it reads no jump; the time slept is added by the caller
+    // with millisAdvance(), which rebases on the counter after this. Delay_Us() busy-waits
+    // on CNT deltas only, so the restored compare value cannot be missed either.
+    SysTick->CTLR = 0;
+    SysTick->CNT = sysTickCount;
+    SysTick->CMP = sysTickCmp;
+    SysTick->CTLR = sysTickCtlr;
+
+    return (ticks << shift) / LOWPOWER_LSI_KHZ;
+}
+#define LOWPOWER_SLEEP(ms) lowPowerStandby(ms)
+#endif
+
+uint32_t lowPowerSweepStart;             // millis() at the broadcast conversion
+uint32_t lowPowerSweepSlept;             // Of that sweep, time spent in standby
+uint32_t lowPowerSweepConvertMs;         // Of that sweep, sensor-milliseconds spent converting
+bool lowPowerSweeping;
+
+/**
+ * @brief Set up the auto-wakeup timer.
+ */
+void LowPowerBegin() {
+#ifdef LOWPOWER_HARDWARE
+    RCC->APB1PCENR |= RCC_APB1Periph_PWR;
+    RCC->RSTSCKR |= RCC_LSION;
+    while ((RCC->RSTSCKR & RCC_LSIRDY) == 0) {
+    }
+    EXTI->EVENR |= EXTI_Line9;           // The AWU wakes the core through event line 9
+    EXTI->FTENR |= EXTI_Line9;
+#endif
+}
+
+/**
+ * @brief Sleep until the scheduler has something to do.
+ * @param ms The time until then, from SchedulerIdleMs().
+ * @return The milliseconds slept, to advance the clock by. 0 if the wait was too short.
+ * Waits up to LOWPOWER_MIN_SLEEP_MS before the deadline are left for the caller to spin.
+ */
+uint32_t LowPowerSleep(uint32_t ms) {
+    uint32_t slept = 0;
+    if (ms > LOWPOWER_MAX_SLEEP_MS) ms = LOWPOWER_MAX_SLEEP_MS;
+    while (ms - slept >= LOWPOWER_MIN_SLEEP_MS) {
+        uint32_t s = LOWPOWER_SLEEP(ms - slept);
+        if (s == 0) {
+            break;
+        }
+        slept += s;
+    }
+    lowPowerSweepSlept += slept;
+    return slept;
+}
+
+/**
+ * @brief Estimated charge drawn in a sweep.
+ * @param totalMs Duration of the sweep.
+ * @param sleptMs Of that, time in standby.
+ * @param convertMs Sensor-milliseconds spent converting.
+ * @return The charge in nanocoulombs (uA * ms).
+ */
+uint32_t LowPowerChargeNc(uint32_t totalMs, uint32_t sleptMs, uint32_t convertMs) {
+    return (totalMs - sleptMs) * LOWPOWER_RUN_UA
+         + sleptMs * LOWPOWER_STANDBY_UA
+         + convertMs * LOWPOWER_CONVERT_UA;
+}
+
+/**
+ * @brief Note a broadcast conversion, which starts a sweep, and report the previous sweep.
+ * @param nowMs The current time in milliseconds.
+ * @param sensors The number of sensors converting.
+ * @param conversionMs How long they convert.
+ */
+void LowPowerSweep(uint32_t nowMs, uint8_t sensors, uint16_t conversionMs) {
+    uint32_t total = nowMs - lowPowerSweepStart;
+    if (lowPowerSweeping && total > 0) {
+        uint32_t charge = LowPowerChargeNc(total, lowPowerSweepSlept, lowPowerSweepConvertMs);
+        LogPuts("Sweep: ");
+        LogPutU32(total);
+        LogPuts("ms, awake ");
+        LogPutU32(total - lowPowerSweepSlept);
+        LogPuts("ms, ~");
+        LogPutU32(charge / 1000 * LOWPOWER_SUPPLY_MV / 1000);
+        LogPuts("uJ, ~");
+        LogPutU32(charge / total);
+        LogPuts("uA average\n");
+    }
+    lowPowerSweeping = true;
+    lowPowerSweepStart = nowMs;
+    lowPowerSweepSlept = 0;
+    lowPowerSweepConvertMs = (uint32_t)sensors * conversionMs;
+}
+
+#else
+
+static inline void LowPowerBegin() { }
+static inline uint32_t LowPowerSleep(uint32_t ms) { (void)ms; return 0; }
+static inline void LowPowerSweep(uint32_t nowMs, uint8_t sensors, uint16_t conversionMs) {
+    (void)nowMs; (void)sensors; (void)conversionMs;
+}
+
+#endif
@@ -158,18 +158,63 @@ sample code bearing this copyright.
 */
 
 #include "ch32v003fun.h"
-#include "ch32v003_GPIO_branchless.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include "OneWireConfig.h"
 #include "OneWire_GPIO_Definitions.h"
+#include "OneWire_Trace.h"
+#include "OneWire_Hotplug.h"
 #include <stdint.h>
 
+// The slots are timed with busy waits, so an interrupt inside one (I2C
+// register map, hot-plug EXTI) would stretch it: a write 1 low pulse long
+// enough to read as 0, or a read sampled after the device let go. Like
+// the Arduino library, interrupts are off from the low edge through the
+// release or sample of every slot, and back on for the recovery time.
+#define noInterrupts() __disable_irq()
+#define interrupts() __enable_irq()
+
+#if ONEWIRE_READ_MULTISAMPLE
+// Read slot sampling. OneWireReset() times how long the pull-up needs to
+// raise the released bus, before any device answers, and keeps a running
+// average. Read slots then take three samples starting just after that
+// rise time and return the majority, so a slow bus is not sampled while
+// still rising and a glitch on one sample does not flip the bit.
+#define ONEWIRE_RISE_MAX_TICKS ((ONEWIRE_T_READ_LAST - ONEWIRE_T_READ_LOW) * DELAY_US_TIME)
+#define ONEWIRE_SAMPLE_MIN_TICKS (1 * DELAY_US_TIME)
+#define ONEWIRE_SAMPLE_MAX_TICKS ((ONEWIRE_T_READ_LAST - ONEWIRE_T_READ_LOW - 2 * ONEWIRE_T_READ_SPACING) * DELAY_US_TIME)
+
+// Average rise time in SysTick ticks, times 4. Starts out so that the middle
+// sample lands where the single sample used to be.
+uint16_t oneWireRiseQ2 = 4 * (ONEWIRE_T_READ_SAMPLE - ONEWIRE_T_READ_SPACING - ONEWIRE_T_READ_MARGIN) * DELAY_US_TIME;
+uint16_t oneWireSampleTicks = (ONEWIRE_T_READ_SAMPLE - ONEWIRE_T_READ_SPACING) * DELAY_US_TIME;
+uint32_t oneWireReadDisagreements;	// Read slots whose samples did not all agree
+#endif
+
+// The strong pullup OneWireWrite() leaves on when asked for 'power'. It
+// is switched off before the next slot, outside the slot's timed part.
+bool oneWirePowered;
+
+static inline __attribute__((always_inline)) void oneWireUnpower(void)
+{
+	if (oneWirePowered) {
+		DIRECT_MODE_RELEASE();
+		oneWirePowered = false;
+	}
+}
+
+#if ONEWIRE_SEARCH
 // global search state
 unsigned char ROM_NO[8];
 uint8_t LastDiscrepancy;
 uint8_t LastFamilyDiscrepancy;
 bool LastDeviceFlag;
+bool LastDeviceFound;	// a pass of this search found a device, so the bus was not empty
+uint32_t OneWireSearchRetries;	// passes retried from their checkpoint
+uint32_t OneWireSearchFailures;	// paths skipped after ONEWIRE_SEARCH_RETRIES
+uint32_t OneWireSearchCutShort;	// of those, skipped before the end of the ROM, see OneWireSearch()
+#endif
 
 void OneWireBegin(void);
 
@@ -190,13 +235,17 @@ void OneWireSelect(const uint8_t rom[8]);
 // another read or write.
 void OneWireWrite(uint8_t v, uint8_t power);
 
+#if ONEWIRE_BYTE_HELPERS
 void OneWireWriteBytes(const uint8_t *buf, uint16_t count, bool power);
+#endif
 
 
 // Read a byte.
 uint8_t OneWireRead(void);
 
+#if ONEWIRE_BYTE_HELPERS
 void OneWireReadBytes(uint8_t *buf, uint16_t count);
+#endif
 
 // Write a bit. The bus is always left powered at the end, see
 // note in write() about that.
@@ -205,14 +254,22 @@ void OneWireWriteBit(uint8_t v);
 // Read a bit.
 uint8_t OneWireReadBit(void);
 
+#if ONEWIRE_READ_MULTISAMPLE
+// Where read slots sample, in microseconds after the bus is released.
+uint8_t OneWireReadSamplePoint(void);
+#endif
+
 // Stop forcing power onto the bus. You only need to do this if
 // you used the 'power' flag to write() or used a write_bit() call
 // and aren't about to do another read or write. You would rather
 // not leave this powered if you don't have to, just in case
 // someone shorts your bus.
+#if ONEWIRE_DEPOWER
 void OneWireDepower(void);
+#endif
 
 
+#if ONEWIRE_SEARCH
 // Clear the search state so that if will start from the beginning again.
 void OneWireResetSearch();
 
@@ -227,12 +284,14 @@ void OneWireTargetSearch(uint8_t family_code);
 // get garbage.  The order is deterministic. You will always get
 // the same devices in the same order.
 bool  OneWireSearch(uint8_t *newAddr, bool search_mode);
+#endif
 
 // Compute a Dallas Semiconductor 8 bit CRC, these are used in the
 // ROM and scratchpad registers.
 uint8_t OneWireCrc8(const uint8_t *addr, uint8_t len);
 
 
+#if ONEWIRE_CRC16
 // Compute the 1-Wire CRC16 and compare it against the received CRC.
 // Example usage (reading a DS2408):
 //    // Put everything in a buffer so we can compute the CRC easily.
@@ -268,11 +327,15 @@ bool OneWireCheckCrc16(const uint8_t* input, uint16_t len, const uint8_t* invert
 // @param crc - The crc starting value (optional)
 // @return The CRC16, as defined by Dallas Semiconductor.
 uint16_t OneWireCrc16(const uint8_t* input, uint16_t len, uint16_t crc);
+#endif
 
 void OneWireBegin()
 {
-	directModeInput();
+	DIRECT_BIND();
+	oneWireHotplugBegin();
+#if ONEWIRE_SEARCH
 	OneWireResetSearch();
+#endif
 }
 
 // Perform the onewire reset function.  We will wait up to 250uS for
@@ -286,7 +349,8 @@ uint8_t OneWireReset(void)
 	uint8_t r;
 	uint8_t retries = 125;
 
-	DIRECT_MODE_INPUT();
+	OneWireHotplugDisarm();	// our own slots are not hot-plug events
+	oneWireUnpower();
 	
 	// wait until the wire is high... just in case
 	do {
@@ -294,16 +358,45 @@ uint8_t OneWireReset(void)
 		Delay_Us(2);
 	} while ( !DIRECT_READ());
 
-	DIRECT_WRITE_LOW();
-	DIRECT_MODE_OUTPUT();	// drive output low
+	noInterrupts();
+	ONEWIRE_TRACE_STAMP(traceLow);
+	DIRECT_WRITE_LOW();	// drive output low
+	interrupts();
 	
-	Delay_Us(480);
+	Delay_Us(ONEWIRE_T_RESET_LOW);
 	
-	DIRECT_MODE_INPUT();	// allow it to float
-	Delay_Us(70);
+	noInterrupts();
+	DIRECT_WRITE_HIGH();	// allow it to float
+	ONEWIRE_TRACE_STAMP(traceRelease);
+#if ONEWIRE_READ_MULTISAMPLE
+	{
+		// Devices wait at least 15us before the presence pulse, so until
+		// then the bus rises through the pull-up alone. Time it.
+		uint32_t release = SysTick->CNT;
+		uint32_t rise;
+		while ((rise = SysTick->CNT - release) < ONEWIRE_RISE_MAX_TICKS && !DIRECT_READ())
+			;
+		if (rise < ONEWIRE_RISE_MAX_TICKS) {
+			oneWireRiseQ2 += rise - (oneWireRiseQ2 >> 2);
+			uint32_t sample = (oneWireRiseQ2 >> 2) + ONEWIRE_T_READ_MARGIN * DELAY_US_TIME;
+			if (sample < ONEWIRE_SAMPLE_MIN_TICKS) sample = ONEWIRE_SAMPLE_MIN_TICKS;
+			if (sample > ONEWIRE_SAMPLE_MAX_TICKS) sample = ONEWIRE_SAMPLE_MAX_TICKS;
+			oneWireSampleTicks = sample;
+		}
+		while (SysTick->CNT - release < ONEWIRE_T_PRESENCE_SAMPLE * DELAY_US_TIME)
+			;
+	}
+#else
+	Delay_Us(ONEWIRE_T_PRESENCE_SAMPLE);
+#endif
 	r = !DIRECT_READ();
+	ONEWIRE_TRACE_STAMP(tracePresence);
+	interrupts();
+	ONEWIRE_TRACE_EVENT(traceLow, ONEWIRE_TRACE_RESET_LOW, 0);
+	ONEWIRE_TRACE_EVENT(traceRelease, ONEWIRE_TRACE_RESET_RELEASE, 1);
+	ONEWIRE_TRACE_EVENT(tracePresence, ONEWIRE_TRACE_PRESENCE, !r);
 	
-	Delay_Us(410);
+	Delay_Us(ONEWIRE_T_RESET_RECOVERY);
 	return r;
 }
 
@@ -313,23 +406,34 @@ uint8_t OneWireReset(void)
 //
 void OneWireWriteBit(uint8_t v)
 {
+	oneWireUnpower();
 
 	if (v & 1) {
 		
-		DIRECT_WRITE_LOW();
-		DIRECT_MODE_OUTPUT();	// drive output low
-		Delay_Us(10);
-		DIRECT_WRITE_HIGH();	// drive output high
+		noInterrupts();
+		ONEWIRE_TRACE_STAMP(traceLow);
+		DIRECT_WRITE_LOW();	// drive output low
+		Delay_Us(ONEWIRE_T_WRITE1_LOW);
+		DIRECT_WRITE_HIGH();	// release, pull up will raise
+		ONEWIRE_TRACE_STAMP(traceHigh);
+		interrupts();
+		ONEWIRE_TRACE_EVENT(traceLow, ONEWIRE_TRACE_WRITE_LOW, 1);
+		ONEWIRE_TRACE_EVENT(traceHigh, ONEWIRE_TRACE_WRITE_HIGH, 1);
 		
-		Delay_Us(55);
+		Delay_Us(ONEWIRE_T_WRITE1_RECOVERY);
 	} else {
 		
-		DIRECT_WRITE_LOW();
-		DIRECT_MODE_OUTPUT();	// drive output low
-		Delay_Us(65);
-		DIRECT_WRITE_HIGH();	// drive output high
+		noInterrupts();
+		ONEWIRE_TRACE_STAMP(traceLow);
+		DIRECT_WRITE_LOW();	// drive output low
+		Delay_Us(ONEWIRE_T_WRITE0_LOW);
+		DIRECT_WRITE_HIGH();	// release, pull up will raise
+		ONEWIRE_TRACE_STAMP(traceHigh);
+		interrupts();
+		ONEWIRE_TRACE_EVENT(traceLow, ONEWIRE_TRACE_WRITE_LOW, 0);
+		ONEWIRE_TRACE_EVENT(traceHigh, ONEWIRE_TRACE_WRITE_HIGH, 1);
 		
-		Delay_Us(5);
+		Delay_Us(ONEWIRE_T_WRITE0_RECOVERY);
 	}
 }
 
@@ -341,23 +445,61 @@ uint8_t OneWireReadBit(void)
 {
 	uint8_t r;
 
-	DIRECT_MODE_OUTPUT();
+	oneWireUnpower();
+	noInterrupts();
+	ONEWIRE_TRACE_STAMP(traceLow);
 	DIRECT_WRITE_LOW();
-	Delay_Us(3);
-	DIRECT_MODE_INPUT();	// let pin float, pull up will raise
-	Delay_Us(10);
+	Delay_Us(ONEWIRE_T_READ_LOW);
+	DIRECT_WRITE_HIGH();	// let pin float, pull up will raise
+	ONEWIRE_TRACE_STAMP(traceRelease);
+#if ONEWIRE_READ_MULTISAMPLE
+	uint32_t release = SysTick->CNT;
+	uint32_t at = oneWireSampleTicks;
+	uint8_t votes = 0;
+	for (uint8_t i = 0; i < 3; i++) {
+		while (SysTick->CNT - release < at)
+			;
+		votes += DIRECT_READ();
+		at += ONEWIRE_T_READ_SPACING * DELAY_US_TIME;
+	}
+	ONEWIRE_TRACE_STAMP(traceSample);
+	interrupts();
+	r = votes >= 2;
+	if (votes == 1 || votes == 2) oneWireReadDisagreements++;
+	ONEWIRE_TRACE_EVENT(traceLow, ONEWIRE_TRACE_READ_LOW, 0);
+	ONEWIRE_TRACE_EVENT(traceRelease, ONEWIRE_TRACE_READ_RELEASE, 1);
+	ONEWIRE_TRACE_EVENT(traceSample, ONEWIRE_TRACE_READ_SAMPLE, r);
+
+	// Keep the slot as long as the single-sample one.
+	while (SysTick->CNT - release < (ONEWIRE_T_READ_SAMPLE + ONEWIRE_T_READ_RECOVERY) * DELAY_US_TIME)
+		;
+#else
+	Delay_Us(ONEWIRE_T_READ_SAMPLE);
 	r = DIRECT_READ();
+	ONEWIRE_TRACE_STAMP(traceSample);
+	interrupts();
+	ONEWIRE_TRACE_EVENT(traceLow, ONEWIRE_TRACE_READ_LOW, 0);
+	ONEWIRE_TRACE_EVENT(traceRelease, ONEWIRE_TRACE_READ_RELEASE, 1);
+	ONEWIRE_TRACE_EVENT(traceSample, ONEWIRE_TRACE_READ_SAMPLE, r);
 	
-	Delay_Us(53);
+	Delay_Us(ONEWIRE_T_READ_RECOVERY);
+#endif
 	return r;
 }
 
+#if ONEWIRE_READ_MULTISAMPLE
+uint8_t OneWireReadSamplePoint(void)
+{
+	return oneWireSampleTicks / DELAY_US_TIME;
+}
+#endif
+
 //
-// Write a byte. The writing code uses the active drivers to raise the
-// pin high, if you need power after the write (e.g. DS18S20 in
-// parasite power mode) then set 'power' to 1, otherwise the pin will
-// go tri-state at the end of the write to avoid heating in a short or
-// other mishap.
+// Write a byte. The pin is open drain, the pull-up raises the bus
+// between slots. If you need power after the write (e.g. DS18S20 in
+// parasite power mode) then set 'power' to 1 and the pin drives the bus
+// high until the next reset, slot or OneWireDepower(); otherwise it is
+// left released to avoid heating in a short or other mishap.
 //
 void OneWireWrite(uint8_t v, uint8_t power /* = 0 */) {
     uint8_t bitMask;
@@ -365,24 +507,22 @@ void OneWireWrite(uint8_t v, uint8_t power /* = 0 */) {
     for (bitMask = 0x01; bitMask; bitMask <<= 1) {
 	    OneWireWriteBit( (bitMask & v)?1:0);
     }
-    if ( !power) {
-	
-      DIRECT_MODE_INPUT();
-      DIRECT_WRITE_LOW();
-	
+    if (power) {
+      DIRECT_MODE_POWER();
+      oneWirePowered = true;
     }
 }
 
+#if ONEWIRE_BYTE_HELPERS
 void OneWireWriteBytes(const uint8_t *buf, uint16_t count, bool power) {
   for (uint16_t i = 0 ; i < count ; i++)
     OneWireWrite(buf[i], 0);
-  if (!power) {
-    
-    DIRECT_MODE_INPUT();
-    DIRECT_WRITE_LOW();
-    
+  if (power) {
+    DIRECT_MODE_POWER();
+    oneWirePowered = true;
   }
 }
+#endif
 
 
 //
@@ -398,10 +538,12 @@ uint8_t OneWireRead() {
     return r;
 }
 
+#if ONEWIRE_BYTE_HELPERS
 void OneWireReadBytes(uint8_t *buf, uint16_t count) {
   for (uint16_t i = 0 ; i < count ; i++)
     buf[i] = OneWireRead();
 }
+#endif
 
 //
 // Do a ROM select
@@ -423,12 +565,14 @@ void OneWireSkip()
     OneWireWrite(0xCC, 0);           // Skip ROM
 }
 
+#if ONEWIRE_DEPOWER
 void OneWireDepower()
 {
-	DIRECT_MODE_INPUT();
-	
+	oneWireUnpower();
 }
+#endif
 
+#if ONEWIRE_SEARCH
 //
 // You need to use this function to start a search again from the beginning.
 // You do not need to do it for the first search, though you could.
@@ -438,6 +582,7 @@ void OneWireResetSearch()
   // reset the search state
   LastDiscrepancy = 0;
   LastDeviceFlag = false;
+  LastDeviceFound = false;
   LastFamilyDiscrepancy = 0;
   for(int i = 7; ; i--) {
     ROM_NO[i] = 0;
@@ -457,29 +602,31 @@ void OneWireTargetSearch(uint8_t family_code)
    LastDiscrepancy = 64;
    LastFamilyDiscrepancy = 0;
    LastDeviceFlag = false;
+   LastDeviceFound = false;
 }
 
-//
-// Perform a search. If this function returns a '1' then it has
-// enumerated the next device and you may retrieve the ROM from the
-// OneWireAddress variable. If there are no devices, no further
-// devices, or something horrible happens in the middle of the
-// enumeration then a 0 is returned.  If a new device is found then
-// its address is copied to newAddr.  Use OneWireReset_search() to
-// start over.
-//
+// Result of one search pass
+#define ONEWIRE_SEARCH_FOUND  0	// ROM in ROM_NO, CRC checked
+#define ONEWIRE_SEARCH_DONE   1	// no more devices
+#define ONEWIRE_SEARCH_FAILED 2	// lost presence, lost devices or a bad CRC
+
 // --- Replaced by the one from the Dallas Semiconductor web site ---
 //--------------------------------------------------------------------------
-// Perform the 1-Wire Search Algorithm on the 1-Wire bus using the existing
-// search state.
-// Return TRUE  : device found, ROM number in ROM_NO buffer
-//        FALSE : device not found, end of search
+// Perform one pass of the 1-Wire Search Algorithm on the 1-Wire bus using
+// the existing search state. On failure the state is left half updated,
+// OneWireSearch() puts its checkpoint back. 'path' receives where the pass
+// went, which is where a search that gives up on this path continues.
 //
-bool OneWireSearch(uint8_t *newAddr, bool search_mode /* = true */)
+typedef struct {
+   uint8_t last_zero;	// last branch point the 0 direction was taken at
+   uint8_t family_zero;	// the same, within the family code, 0 if none
+   uint8_t fail_bit;	// bit no device answered at, 0 if the whole ROM was read
+} OneWireSearchPath;
+
+static uint8_t oneWireSearchPass(bool search_mode, OneWireSearchPath *path)
 {
    uint8_t id_bit_number;
    uint8_t last_zero, rom_byte_number;
-   bool    search_result;
    uint8_t id_bit, cmp_id_bit;
 
    unsigned char rom_byte_mask, search_direction;
@@ -489,107 +636,170 @@ bool OneWireSearch(uint8_t *newAddr, bool search_mode /* = true */)
    last_zero = 0;
    rom_byte_number = 0;
    rom_byte_mask = 1;
-   search_result = false;
-
-   // if the last call was not the last one
-   if (!LastDeviceFlag) {
-      // 1-Wire reset
-      if (!OneWireReset()) {
-         // reset the search
-         LastDiscrepancy = 0;
-         LastDeviceFlag = false;
-         LastFamilyDiscrepancy = 0;
-         return false;
-      }
+   path->last_zero = 0;
+   path->family_zero = 0;
+   path->fail_bit = 1;
+
+   // if the last call was the last one
+   if (LastDeviceFlag)
+      return ONEWIRE_SEARCH_DONE;
+
+   // 1-Wire reset, no presence on the first pass just means an empty bus,
+   // also for a targeted search, which presets LastDiscrepancy
+   if (!OneWireReset())
+      return LastDeviceFound ? ONEWIRE_SEARCH_FAILED : ONEWIRE_SEARCH_DONE;
+
+   // issue the search command
+   if (search_mode == true) {
+     OneWireWrite(0xF0, 0);   // NORMAL SEARCH
+   } else {
+     OneWireWrite(0xEC, 0);   // CONDITIONAL SEARCH
+   }
 
-      // issue the search command
-      if (search_mode == true) {
-        OneWireWrite(0xF0, 0);   // NORMAL SEARCH
-      } else {
-        OneWireWrite(0xEC, 0);   // CONDITIONAL SEARCH
+   // loop to do the search
+   do
+   {
+      // read a bit and its complement
+      id_bit = OneWireReadBit();
+      cmp_id_bit = OneWireReadBit();
+
+      // no device answered: they left the bus or a bit was lost
+      if ((id_bit == 1) && (cmp_id_bit == 1)) {
+         path->fail_bit = id_bit_number;
+         return ONEWIRE_SEARCH_FAILED;
       }
 
-      // loop to do the search
-      do
-      {
-         // read a bit and its complement
-         id_bit = OneWireReadBit();
-         cmp_id_bit = OneWireReadBit();
-
-         // check for no devices on 1-wire
-         if ((id_bit == 1) && (cmp_id_bit == 1)) {
-            break;
+      // all devices coupled have 0 or 1
+      if (id_bit != cmp_id_bit) {
+         search_direction = id_bit;  // bit write value for search
+      } else {
+         // if this discrepancy if before the Last Discrepancy
+         // on a previous next then pick the same as last time
+         if (id_bit_number < LastDiscrepancy) {
+            search_direction = ((ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
          } else {
-            // all devices coupled have 0 or 1
-            if (id_bit != cmp_id_bit) {
-               search_direction = id_bit;  // bit write value for search
-            } else {
-               // if this discrepancy if before the Last Discrepancy
-               // on a previous next then pick the same as last time
-               if (id_bit_number < LastDiscrepancy) {
-                  search_direction = ((ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
-               } else {
-                  // if equal to last pick 1, if not then pick 0
-                  search_direction = (id_bit_number == LastDiscrepancy);
-               }
-               // if 0 was picked then record its position in LastZero
-               if (search_direction == 0) {
-                  last_zero = id_bit_number;
-
-                  // check for Last discrepancy in family
-                  if (last_zero < 9)
-                     LastFamilyDiscrepancy = last_zero;
-               }
-            }
-
-            // set or clear the bit in the ROM byte rom_byte_number
-            // with mask rom_byte_mask
-            if (search_direction == 1)
-              ROM_NO[rom_byte_number] |= rom_byte_mask;
-            else
-              ROM_NO[rom_byte_number] &= ~rom_byte_mask;
-
-            // serial number search direction write bit
-            OneWireWriteBit(search_direction);
-
-            // increment the byte counter id_bit_number
-            // and shift the mask rom_byte_mask
-            id_bit_number++;
-            rom_byte_mask <<= 1;
-
-            // if the mask is 0 then go to new SerialNum byte rom_byte_number and reset mask
-            if (rom_byte_mask == 0) {
-                rom_byte_number++;
-                rom_byte_mask = 1;
+            // if equal to last pick 1, if not then pick 0
+            search_direction = (id_bit_number == LastDiscrepancy);
+         }
+         // if 0 was picked then record its position in LastZero
+         if (search_direction == 0) {
+            last_zero = id_bit_number;
+            path->last_zero = last_zero;
+
+            // check for Last discrepancy in family
+            if (last_zero < 9) {
+               LastFamilyDiscrepancy = last_zero;
+               path->family_zero = last_zero;
             }
          }
       }
-      while(rom_byte_number < 8);  // loop until through all ROM bytes 0-7
 
-      // if the search was successful then
-      if (!(id_bit_number < 65)) {
-         // search successful so set LastDiscrepancy,LastDeviceFlag,search_result
-         LastDiscrepancy = last_zero;
+      // set or clear the bit in the ROM byte rom_byte_number
+      // with mask rom_byte_mask
+      if (search_direction == 1)
+        ROM_NO[rom_byte_number] |= rom_byte_mask;
+      else
+        ROM_NO[rom_byte_number] &= ~rom_byte_mask;
+
+      // serial number search direction write bit
+      OneWireWriteBit(search_direction);
+
+      // increment the byte counter id_bit_number
+      // and shift the mask rom_byte_mask
+      id_bit_number++;
+      rom_byte_mask <<= 1;
+
+      // if the mask is 0 then go to new SerialNum byte rom_byte_number and reset mask
+      if (rom_byte_mask == 0) {
+          rom_byte_number++;
+          rom_byte_mask = 1;
+      }
+   }
+   while(rom_byte_number < 8);  // loop until through all ROM bytes 0-7
+   path->fail_bit = 0;
 
-         // check for last device
-         if (LastDiscrepancy == 0) {
-            LastDeviceFlag = true;
-         }
-         search_result = true;
+   // a bit error shows up as a bad CRC, a shorted bus as all zeros
+   if (!ROM_NO[0] || OneWireCrc8(ROM_NO, 7) != ROM_NO[7])
+      return ONEWIRE_SEARCH_FAILED;
+
+   // search successful so set LastDiscrepancy,LastDeviceFlag
+   LastDiscrepancy = last_zero;
+   LastDeviceFound = true;
+
+   // check for last device
+   if (LastDiscrepancy == 0) {
+      LastDeviceFlag = true;
+   }
+   return ONEWIRE_SEARCH_FOUND;
+}
+
+//
+// Perform a search. If this function returns a '1' then it has
+// enumerated the next device and you may retrieve the ROM from the
+// OneWireAddress variable. If there are no devices, no further
+// devices, or something horrible happens in the middle of the
+// enumeration then a 0 is returned.  If a new device is found then
+// its address is copied to newAddr.  Use OneWireReset_search() to
+// start over.
+//
+// The ROM is CRC checked. A pass that fails is retried from the same
+// branch point up to ONEWIRE_SEARCH_RETRIES times. After that the path
+// it keeps failing on is skipped like a found device, and the search
+// goes on from its last branch point. A path that failed on the CRC is
+// exactly one device with a bad ROM, nothing else is lost. A path that
+// failed part way through the ROM (no device answered a bit) also skips
+// any device that shares its bits up to the failing one and differs only
+// after it; OneWireSearchCutShort counts those skips, and the next
+// enumeration finds such devices if the error was transient.
+//
+bool OneWireSearch(uint8_t *newAddr, bool search_mode /* = true */)
+{
+   uint8_t result;
+   OneWireSearchPath path;
+
+   for (;;) {
+      // checkpoint, a failed pass restarts from here instead of from the
+      // first device
+      uint8_t rom[8];
+      uint8_t lastDiscrepancy = LastDiscrepancy;
+      uint8_t lastFamilyDiscrepancy = LastFamilyDiscrepancy;
+      uint8_t tries = 0;
+
+      memcpy(rom, ROM_NO, 8);
+      while ((result = oneWireSearchPass(search_mode, &path)) == ONEWIRE_SEARCH_FAILED
+             && tries++ < ONEWIRE_SEARCH_RETRIES) {
+         memcpy(ROM_NO, rom, 8);
+         LastDiscrepancy = lastDiscrepancy;
+         LastFamilyDiscrepancy = lastFamilyDiscrepancy;
+         OneWireSearchRetries++;
+      }
+      if (result != ONEWIRE_SEARCH_FAILED)
+         break;
+
+      // give up on this path: continue at its last branch point as if
+      // the device at its end had been found, or stop if there is none
+      OneWireSearchFailures++;
+      if (path.fail_bit) OneWireSearchCutShort++;
+      LastDiscrepancy = path.last_zero;
+      LastFamilyDiscrepancy = path.family_zero ? path.family_zero : lastFamilyDiscrepancy;
+      if (path.last_zero == 0) {
+         result = ONEWIRE_SEARCH_DONE;
+         break;
       }
    }
 
    // if no device found then reset counters so next 'search' will be like a first
-   if (!search_result || !ROM_NO[0]) {
+   if (result != ONEWIRE_SEARCH_FOUND) {
       LastDiscrepancy = 0;
       LastDeviceFlag = false;
+      LastDeviceFound = false;
       LastFamilyDiscrepancy = 0;
-      search_result = false;
-   } else {
-      for (int i = 0; i < 8; i++) newAddr[i] = ROM_NO[i];
+      return false;
    }
-   return search_result;
-  }
+   for (int i = 0; i < 8; i++) newAddr[i] = ROM_NO[i];
+   return true;
+}
+#endif
 
 
 
@@ -597,6 +807,29 @@ bool OneWireSearch(uint8_t *newAddr, bool search_mode /* = true */)
 // "Understanding and Using Cyclic Redundancy Checks with Maxim iButton Products"
 //
 
+#if ONEWIRE_CRC8_NIBBLE
+//
+// Compute a Dallas Semiconductor 8 bit CRC with two 16 entry tables,
+// one per nibble. Twice as fast as the direct version for 32 bytes of
+// flash, and far smaller than the 256 byte table.
+//
+uint8_t OneWireCrc8(const uint8_t *addr, uint8_t len)
+{
+	static const uint8_t table_lo[16] = {
+		0x00, 0x5E, 0xBC, 0xE2, 0x61, 0x3F, 0xDD, 0x83,
+		0xC2, 0x9C, 0x7E, 0x20, 0xA3, 0xFD, 0x1F, 0x41 };
+	static const uint8_t table_hi[16] = {
+		0x00, 0x9D, 0x23, 0xBE, 0x46, 0xDB, 0x65, 0xF8,
+		0x8C, 0x11, 0xAF, 0x32, 0xCA, 0x57, 0xE9, 0x74 };
+	uint8_t crc = 0;
+
+	while (len--) {
+		uint8_t i = crc ^ *addr++;
+		crc = table_lo[i & 0x0F] ^ table_hi[i >> 4];
+	}
+	return crc;
+}
+#else
 //
 // Compute a Dallas Semiconductor 8 bit CRC directly.
 // this is much slower, but a little smaller, than the lookup table.
@@ -616,7 +849,9 @@ uint8_t OneWireCrc8(const uint8_t *addr, uint8_t len)
 	}
 	return crc;
 }
+#endif
 
+#if ONEWIRE_CRC16
 bool OneWireCheckCrc16(const uint8_t* input, uint16_t len, const uint8_t* inverted_crc, uint16_t crc)
 {
     crc = ~OneWireCrc16(input, len, crc);
@@ -647,4 +882,4 @@ uint16_t OneWireCrc16(const uint8_t* input, uint16_t len, uint16_t crc)
 
     return crc;
 }
-
+#endif
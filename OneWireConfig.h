@@ -0,0 +1,118 @@
+#ifndef _ONEWIRECONFIG_H
+#define _ONEWIRECONFIG_H
+
+// Feature switches for the 1-Wire driver and the sensor firmware.
+//
+// Pick a profile with ONEWIRE_PROFILE (e.g. make PROFILE=MINIMAL), or
+// override single switches with -D. Every switch set to 0 removes its code
+// and RAM from the build. `make size-report` builds every profile and
+// prints its flash and RAM use.
+
+#define ONEWIRE_PROFILE_FULL 0          // Everything on
+#define ONEWIRE_PROFILE_MINIMAL 1       // Search and DS18x20 reads only, more sensor slots
+#define ONEWIRE_PROFILE_FIXED_ROM 2     // Minimal, with a fixed ROM list instead of the search engine
+
+#define ONEWIRE_OUTPUT_FLOAT 0          // Temperatures printed via float math
+#define ONEWIRE_OUTPUT_FIXED 1          // Temperatures printed from Q4 fixed point, no float code
+
+#ifndef ONEWIRE_PROFILE
+#define ONEWIRE_PROFILE ONEWIRE_PROFILE_FULL
+#endif
+
+#if ONEWIRE_PROFILE == ONEWIRE_PROFILE_FULL
+#define ONEWIRE_PROFILE_SMALL 0
+#else
+#define ONEWIRE_PROFILE_SMALL 1
+#endif
+
+// Bus driver
+
+#ifndef ONEWIRE_SEARCH                  // 1: search engine, 0: sensors from ONEWIRE_FIXED_ROMS
+#define ONEWIRE_SEARCH (ONEWIRE_PROFILE != ONEWIRE_PROFILE_FIXED_ROM)
+#endif
+
+#ifndef ONEWIRE_SEARCH_RETRIES          // Retries of a failed search pass from its checkpoint
+#define ONEWIRE_SEARCH_RETRIES 3
+#endif
+
+#ifndef ONEWIRE_FIXED_ROMS              // Sensors used when ONEWIRE_SEARCH is 0, replace with yours
+#define ONEWIRE_FIXED_ROMS { 0x28, 0xFF, 0x64, 0x1E, 0x0F, 0x16, 0x03, 0x90 }
+#endif
+
+#ifndef ONEWIRE_CRC8_NIBBLE             // 1: CRC8 with two 16 byte tables, 0: bitwise CRC8
+#define ONEWIRE_CRC8_NIBBLE 0
+#endif
+
+#ifndef ONEWIRE_CRC16                   // CRC16 for devices that use it (not the DS18x20)
+#define ONEWIRE_CRC16 (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_BYTE_HELPERS            // OneWireWriteBytes()/OneWireReadBytes()
+#define ONEWIRE_BYTE_HELPERS (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_DEPOWER                 // OneWireDepower() for parasite power
+#define ONEWIRE_DEPOWER (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_TRACE                   // Bus transaction tracer, see OneWire_Trace.h
+#define ONEWIRE_TRACE 0
+#endif
+
+#ifndef ONEWIRE_READ_MULTISAMPLE        // 1: majority of three samples per read slot at a rise-time tuned point
+#define ONEWIRE_READ_MULTISAMPLE (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_HOTPLUG                 // Presence-pulse hot-plug detection via EXTI, see OneWire_Hotplug.h
+#define ONEWIRE_HOTPLUG (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+// Firmware
+
+#ifndef ONEWIRE_ASYNC                   // 1: overlapped conversions with per-ROM policies, 0: one sensor at a time
+#define ONEWIRE_ASYNC (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_FAST_READ               // Two byte scratchpad reads with plausibility checks instead of CRC-checked ones
+#define ONEWIRE_FAST_READ (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_COUPLER                 // DS2409 coupler branches, needs ONEWIRE_SEARCH, see BranchCoupler.c
+#define ONEWIRE_COUPLER (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_FAMILIES                // DS2438/DS2408/DS2431 drivers besides the DS18x20, see FamilyDrivers.c
+#define ONEWIRE_FAMILIES (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_REGMAP                  // Register map served to a host over I2C
+#define ONEWIRE_REGMAP (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_LOWPOWER                // Broadcast conversions and standby between sweeps, see LowPower.c
+#define ONEWIRE_LOWPOWER 0
+#endif
+
+#ifndef ONEWIRE_PLANNER                 // Conversions timed against the bus plan, see BusPlanner.c
+#define ONEWIRE_PLANNER (!ONEWIRE_PROFILE_SMALL)
+#endif
+
+#ifndef ONEWIRE_OUTPUT_FORMAT
+#if ONEWIRE_PROFILE_SMALL
+#define ONEWIRE_OUTPUT_FORMAT ONEWIRE_OUTPUT_FIXED
+#else
+#define ONEWIRE_OUTPUT_FORMAT ONEWIRE_OUTPUT_FLOAT
+#endif
+#endif
+
+// RAM freed by the small profiles goes to sensor slots.
+#if ONEWIRE_PROFILE_SMALL
+#ifndef SENSOR_HISTORY_SLOTS
+#define SENSOR_HISTORY_SLOTS 12
+#endif
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 64
+#endif
+#endif
+
+#endif
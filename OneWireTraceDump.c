@@ -0,0 +1,230 @@
+/**
+ * @file OneWireTraceDump.c
+ * @brief Converts the 1-Wire trace ring into VCD and slot timing margins
+ * @license MIT License
+ * @details Works on the events recorded by OneWire_Trace.h when ONEWIRE_TRACE is 1.
+ *
+ * OneWireTraceDumpVcd() writes the ring to the log as a VCD file with three signals:
+ * 'drive' (1 while the master pulls the bus low), 'sample' (the last level the master
+ * sampled) and 'presence' (1 while the last reset saw a presence pulse). Cut the text
+ * between the $timescale line and the END VCD marker out of a serial capture and open it
+ * in PulseView or GTKWave.
+ *
+ * OneWireTraceMargins() measures every complete slot in the ring against the 1-Wire spec
+ * and logs the worst case margin per slot type in nanoseconds. Negative means violated.
+ *
+ * OneWireTraceDumpRaw() logs the ring as recorded, one "ticks event level" line per event,
+ * for tools/trace_replay.c. OneWireTraceDump() includes it with ONEWIRE_TRACE_RAW set to 1.
+ *
+ * Both wait for log buffer space, so only call them outside time critical work, e.g.
+ * after a failed read. Single-file module, included by temp-sensors.c after LogOutput.c.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if ONEWIRE_TRACE
+
+#ifndef ONEWIRE_TRACE_RAW
+#define ONEWIRE_TRACE_RAW 0              // OneWireTraceDump() also logs the raw ring
+#endif
+
+#define TRACE_SPEC_SAMPLE_NS 15000       // Master samples and write-1 low end within 15us
+#define TRACE_SPEC_WRITE0_NS 60000       // Write-0 low time at least 60us
+#define TRACE_SPEC_RESET_NS 480000       // Reset low time at least 480us
+#define TRACE_SPEC_PRESENCE_MIN_NS 60000 // Presence is guaranteed low from 60us...
+#define TRACE_SPEC_PRESENCE_MAX_NS 75000 // ...to 75us after release
+
+// Convert SysTick ticks to nanoseconds without overflowing on long gaps.
+static uint32_t traceNs(uint32_t ticks) {
+    return (ticks / DELAY_US_TIME) * 1000 + ((ticks % DELAY_US_TIME) * 1000) / DELAY_US_TIME;
+}
+
+// Wait until the log has drained, so the next line cannot be dropped.
+static void traceWaitForLog() {
+    while (!LogIdle()) {
+        LogService();
+    }
+}
+
+static void traceLine(const char *s) {
+    traceWaitForLog();
+    LogPuts(s);
+}
+
+/**
+ * @brief Write the trace ring to the log as a VCD file.
+ * Recording is paused while dumping.
+ */
+void OneWireTraceDumpVcd() {
+    uint16_t count = (oneWireTraceHead < ONEWIRE_TRACE_DEPTH) ? oneWireTraceHead : ONEWIRE_TRACE_DEPTH;
+    uint16_t first = oneWireTraceHead - count;
+    if (count == 0) {
+        return;
+    }
+    oneWireTraceEnabled = 0;
+
+    traceLine("$timescale 1ns $end\n");
+    traceLine("$scope module onewire $end\n");
+    traceLine("$var wire 1 ! drive $end\n");
+    traceLine("$var wire 1 \" sample $end\n");
+    traceLine("$var wire 1 # presence $end\n");
+    traceLine("$upscope $end\n");
+    traceLine("$enddefinitions $end\n");
+    traceLine("#0\n");
+    traceLine("0!\n");
+    traceLine("x\"\n");
+    traceLine("x#\n");
+
+    uint32_t t0 = oneWireTraceTime[first & (ONEWIRE_TRACE_DEPTH - 1)];
+    for (uint16_t n = 0; n < count; n++) {
+        uint16_t i = (first + n) & (ONEWIRE_TRACE_DEPTH - 1);
+        uint8_t event = oneWireTraceEvent[i] >> 1;
+        uint8_t level = oneWireTraceEvent[i] & 1;
+
+        traceWaitForLog();
+        LogPutc('#');
+        LogPutU32(traceNs(oneWireTraceTime[i] - t0));
+        LogPutc('\n');
+
+        traceWaitForLog();
+        switch (event) {
+            case ONEWIRE_TRACE_RESET_LOW:
+            case ONEWIRE_TRACE_WRITE_LOW:
+            case ONEWIRE_TRACE_READ_LOW:
+                LogPuts("1!\n");
+                break;
+            case ONEWIRE_TRACE_RESET_RELEASE:
+            case ONEWIRE_TRACE_WRITE_HIGH:
+            case ONEWIRE_TRACE_READ_RELEASE:
+                LogPuts("0!\n");
+                break;
+            case ONEWIRE_TRACE_PRESENCE:
+                LogPuts(level ? "0#\n" : "1#\n");
+                break;
+            case ONEWIRE_TRACE_READ_SAMPLE:
+                LogPuts(level ? "1\"\n" : "0\"\n");
+                break;
+        }
+    }
+    traceLine("END VCD\n");
+
+    oneWireTraceEnabled = 1;
+}
+
+/**
+ * @brief Write the trace ring to the log as recorded, for a host replay.
+ */
+void OneWireTraceDumpRaw() {
+    uint16_t count = (oneWireTraceHead < ONEWIRE_TRACE_DEPTH) ? oneWireTraceHead : ONEWIRE_TRACE_DEPTH;
+    uint16_t first = oneWireTraceHead - count;
+
+    for (uint16_t n = 0; n < count; n++) {
+        uint16_t i = (first + n) & (ONEWIRE_TRACE_DEPTH - 1);
+        traceWaitForLog();
+        LogPutU32(oneWireTraceTime[i]);
+        LogPutc(' ');
+        LogPutU32(oneWireTraceEvent[i] >> 1);
+        LogPutc(' ');
+        LogPutU32(oneWireTraceEvent[i] & 1);
+        LogPutc('\n');
+    }
+    traceLine("END TRACE\n");
+}
+
+static void traceMarginLine(const char *name, int32_t worst, uint16_t slots) {
+    traceWaitForLog();
+    LogPuts(name);
+    if (slots) {
+        LogPutI32(worst);
+        LogPuts(" ns over ");
+        LogPutU32(slots);
+        LogPuts(" slots\n");
+    } else {
+        LogPuts("none\n");
+    }
+}
+
+static void traceKeepWorst(int32_t margin, int32_t *worst, uint16_t *slots) {
+    if (*slots == 0 || margin < *worst) *worst = margin;
+    (*slots)++;
+}
+
+/**
+ * @brief Log the worst case timing margin per slot type found in the trace ring.
+ */
+void OneWireTraceMargins() {
+    uint16_t count = (oneWireTraceHead < ONEWIRE_TRACE_DEPTH) ? oneWireTraceHead : ONEWIRE_TRACE_DEPTH;
+    uint16_t first = oneWireTraceHead - count;
+
+    int32_t worstReset = 0, worstPresence = 0, worstWrite0 = 0, worstWrite1 = 0, worstRead = 0;
+    uint16_t resets = 0, presences = 0, write0s = 0, write1s = 0, reads = 0;
+
+    // Start of the current slot, only valid once its opening event is in the ring.
+    bool haveStart = false;
+    uint8_t startLevel = 0;
+    uint32_t start = 0;
+
+    for (uint16_t n = 0; n < count; n++) {
+        uint16_t i = (first + n) & (ONEWIRE_TRACE_DEPTH - 1);
+        uint8_t event = oneWireTraceEvent[i] >> 1;
+        uint8_t level = oneWireTraceEvent[i] & 1;
+        uint32_t t = oneWireTraceTime[i];
+        int32_t elapsed = haveStart ? (int32_t)traceNs(t - start) : 0;
+
+        switch (event) {
+            case ONEWIRE_TRACE_RESET_LOW:
+            case ONEWIRE_TRACE_WRITE_LOW:
+            case ONEWIRE_TRACE_READ_LOW:
+                haveStart = true;
+                start = t;
+                startLevel = level;
+                break;
+            case ONEWIRE_TRACE_RESET_RELEASE:
+                if (haveStart) traceKeepWorst(elapsed - TRACE_SPEC_RESET_NS, &worstReset, &resets);
+                // Presence is timed from the release.
+                start = t;
+                break;
+            case ONEWIRE_TRACE_PRESENCE:
+                if (haveStart) {
+                    int32_t early = elapsed - TRACE_SPEC_PRESENCE_MIN_NS;
+                    int32_t late = TRACE_SPEC_PRESENCE_MAX_NS - elapsed;
+                    traceKeepWorst(early < late ? early : late, &worstPresence, &presences);
+                }
+                haveStart = false;
+                break;
+            case ONEWIRE_TRACE_WRITE_HIGH:
+                if (haveStart) {
+                    if (startLevel) traceKeepWorst(TRACE_SPEC_SAMPLE_NS - elapsed, &worstWrite1, &write1s);
+                    else traceKeepWorst(elapsed - TRACE_SPEC_WRITE0_NS, &worstWrite0, &write0s);
+                }
+                haveStart = false;
+                break;
+            case ONEWIRE_TRACE_READ_SAMPLE:
+                if (haveStart) traceKeepWorst(TRACE_SPEC_SAMPLE_NS - elapsed, &worstRead, &reads);
+                haveStart = false;
+                break;
+        }
+    }
+
+    traceLine("1-Wire slot timing margins, worst case:\n");
+    traceMarginLine("reset low: ", worstReset, resets);
+    traceMarginLine("presence sample: ", worstPresence, presences);
+    traceMarginLine("write 0 low: ", worstWrite0, write0s);
+    traceMarginLine("write 1 low: ", worstWrite1, write1s);
+    traceMarginLine("read sample: ", worstRead, reads);
+}
+
+/**
+ * @brief Dump the trace as VCD followed by the timing margins, then clear it.
+ */
+void OneWireTraceDump() {
+    if (ONEWIRE_TRACE_RAW) {
+        OneWireTraceDumpRaw();
+    }
+    OneWireTraceDumpVcd();
+    OneWireTraceMargins();
+    oneWireTraceHead = 0;
+}
+
+#endif
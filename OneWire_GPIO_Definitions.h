@@ -3,46 +3,97 @@
 #include "ch32v003fun.h"
 
 // This header should ONLY be included by OneWire.cpp.  These defines are
-// meant to be private, used within OneWire.cpp, other libraries which may 
+// meant to be private, used within OneWire.cpp, other libraries which may
 // include OneWire.h.
 
 #include <stdint.h>
 
+// Bus pin, override before including OneWire.c to move the bus (define
+// ONEWIRE_PORT_INDEX together with ONEWIRE_PORT).
+#ifndef ONEWIRE_PORT
+#define ONEWIRE_PORT GPIOC
+#define ONEWIRE_PORT_INDEX 2    // AFIO port number of ONEWIRE_PORT: A = 0, C = 2, D = 3
+#endif
+#ifndef ONEWIRE_PORT_INDEX
+#error "Define ONEWIRE_PORT_INDEX together with ONEWIRE_PORT"
+#endif
+#ifndef ONEWIRE_PIN
+#define ONEWIRE_PIN 4
+#endif
+
+#include "OneWire_Timing.h"
+
+// Slot timings against the clock. SysTick counts DELAY_US_TIME ticks per us
+// (HCLK/8 with ch32v003fun's default), so every delay is only known to
+// within a tick. The shortest delay has to span ONEWIRE_MIN_DELAY_TICKS for
+// that error to stay small, and the spec deadlines have to hold with one
+// tick of error added.
+#ifndef ONEWIRE_MIN_DELAY_TICKS
+#define ONEWIRE_MIN_DELAY_TICKS 3
+#endif
+
+_Static_assert(DELAY_US_TIME >= 1, "Core clock too slow for microsecond slot timing");
+_Static_assert(ONEWIRE_T_READ_LOW * DELAY_US_TIME >= ONEWIRE_MIN_DELAY_TICKS, "Read slot start pulse shorter than ONEWIRE_MIN_DELAY_TICKS");
+_Static_assert(ONEWIRE_T_WRITE1_LOW * DELAY_US_TIME >= ONEWIRE_MIN_DELAY_TICKS, "Write 1 low time shorter than ONEWIRE_MIN_DELAY_TICKS");
+_Static_assert(ONEWIRE_T_WRITE0_RECOVERY * DELAY_US_TIME >= ONEWIRE_MIN_DELAY_TICKS, "Write 0 recovery shorter than ONEWIRE_MIN_DELAY_TICKS");
+_Static_assert(ONEWIRE_T_READ_SPACING * DELAY_US_TIME >= 1, "Read samples closer than one SysTick tick");
+_Static_assert((ONEWIRE_T_READ_LOW + ONEWIRE_T_READ_SAMPLE) * DELAY_US_TIME + 1 <= 15 * DELAY_US_TIME, "Read sample can miss 15us by a SysTick tick");
+_Static_assert(ONEWIRE_T_READ_LAST * DELAY_US_TIME + 1 <= 15 * DELAY_US_TIME, "Last read sample can miss 15us by a SysTick tick");
+_Static_assert(ONEWIRE_T_WRITE1_LOW * DELAY_US_TIME + 1 <= 15 * DELAY_US_TIME, "Write 1 low time can miss 15us by a SysTick tick");
+
 // Platform specific I/O definitions
+//
+// ONEWIRE_BUS_DEFINE(name, port, portIndex, pin) generates the pin
+// accessors for one bus. Port and pin are constants, so every accessor
+// folds to a few instructions.
+//
+// The pin stays an open-drain output: writeLow() pulls the bus low with a
+// BCR store, writeHigh() releases it with a BSHR store and the pull-up
+// raises it, and read() sees the bus level through INDR either way. So the
+// reset and bit slots are single stores that touch no other pin.
+//
+// CFGLR is only written by bind() and by the strong pullup switches:
+// modePower() makes the pin push-pull, so the released (high) pin drives
+// the bus for parasite powered devices, and modeRelease() goes back to open
+// drain. Each rewrites only the bus pin's nibble with interrupts off, so an
+// interrupt handler cannot lose a change it makes to another pin of the
+// port. Code that reconfigures other pins from the main loop needs no care,
+// the two never run at the same time.
+#define ONEWIRE_BUS_DEFINE(name, port, portIndex, pin) \
+    _Static_assert((pin) < 8, "CH32V003 ports have pins 0..7"); \
+    _Static_assert((portIndex) == 0 || (portIndex) == 2 || (portIndex) == 3, "CH32V003 has ports A, C and D"); \
+    static inline __attribute__((always_inline)) void name##_setMode(uint32_t mode) { \
+        __disable_irq(); \
+        (port)->CFGLR = ((port)->CFGLR & ~(0xFu << (4 * (pin)))) | (mode << (4 * (pin))); \
+        __enable_irq(); \
+    } \
+    static inline __attribute__((always_inline)) void name##_modeRelease(void) { \
+        name##_setMode(GPIO_Speed_50MHz | GPIO_CNF_OUT_OD); \
+    } \
+    static inline __attribute__((always_inline)) void name##_modePower(void) { \
+        name##_setMode(GPIO_Speed_50MHz | GPIO_CNF_OUT_PP); \
+    } \
+    static inline __attribute__((always_inline)) void name##_bind(void) { \
+        RCC->APB2PCENR |= RCC_APB2Periph_GPIOA << (portIndex); \
+        (port)->BSHR = 1u << (pin); \
+        name##_modeRelease(); \
+    } \
+    static inline __attribute__((always_inline)) uint8_t name##_read(void) { \
+        return ((port)->INDR >> (pin)) & 1; \
+    } \
+    static inline __attribute__((always_inline)) void name##_writeLow(void) { \
+        (port)->BCR = 1u << (pin); \
+    } \
+    static inline __attribute__((always_inline)) void name##_writeHigh(void) { \
+        (port)->BSHR = 1u << (pin); \
+    }
+
+ONEWIRE_BUS_DEFINE(oneWireBus, ONEWIRE_PORT, ONEWIRE_PORT_INDEX, ONEWIRE_PIN)
 
-static inline __attribute__((always_inline))
-uint8_t directRead()
-{
-    return GPIO_digitalRead(GPIOv_from_PORT_PIN(GPIO_port_C, 4));
-}
-
-static inline __attribute__((always_inline))
-void directModeInput()
-{
-    GPIO_pinMode(GPIOv_from_PORT_PIN(GPIO_port_C, 4), GPIO_pinMode_I_floating, GPIO_Speed_50MHz);
-}
-
-static inline __attribute__((always_inline))
-void directModeOutput()
-{
-    GPIO_pinMode(GPIOv_from_PORT_PIN(GPIO_port_C, 4), GPIO_pinMode_O_pushPull, GPIO_Speed_50MHz);
-}
-
-static inline __attribute__((always_inline))
-void directWriteLow()
-{
-    GPIO_digitalWrite_lo(GPIOv_from_PORT_PIN(GPIO_port_C, 4));
-}
-
-static inline __attribute__((always_inline))
-void directWriteHigh()
-{
-    GPIO_digitalWrite_hi(GPIOv_from_PORT_PIN(GPIO_port_C, 4));
-}
-
-#define DIRECT_READ()          directRead()
-#define DIRECT_WRITE_LOW()     directWriteLow()
-#define DIRECT_WRITE_HIGH()    directWriteHigh()
-#define DIRECT_MODE_INPUT()    directModeInput()
-#define DIRECT_MODE_OUTPUT()   directModeOutput()
-#endif
\ No newline at end of file
+#define DIRECT_BIND()          oneWireBus_bind()         // Clock on, bus released, open drain
+#define DIRECT_READ()          oneWireBus_read()
+#define DIRECT_WRITE_LOW()     oneWireBus_writeLow()     // Pull the bus low
+#define DIRECT_WRITE_HIGH()    oneWireBus_writeHigh()    // Release the bus, drive it while powered
+#define DIRECT_MODE_POWER()    oneWireBus_modePower()    // Strong pullup on
+#define DIRECT_MODE_RELEASE()  oneWireBus_modeRelease()  // Strong pullup off
+#endif
@@ -0,0 +1,80 @@
+#ifndef OneWire_Hotplug_h
+#define OneWire_Hotplug_h
+#include "ch32v003fun.h"
+
+// Hot-plug detection, included by OneWire.c.
+//
+// A DS18x20 sends a presence pulse when it powers up on the bus. With
+// ONEWIRE_HOTPLUG (see OneWireConfig.h) set to 1, the idle bus is watched by
+// an EXTI falling edge interrupt on the data pin, so a newly attached device
+// is noticed within microseconds instead of on the next periodic search.
+//
+// Our own slots pull the line low too, so the interrupt is only armed while
+// the bus is idle: OneWireReset() disarms it at the start of every
+// transaction and the caller re-arms it once it has nothing left to do on
+// the bus. With ONEWIRE_HOTPLUG set to 0 the calls compile to nothing.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if ONEWIRE_HOTPLUG
+
+#define ONEWIRE_EXTI_LINE (1u << ONEWIRE_PIN)
+
+volatile bool oneWireHotplugEvent;
+volatile bool oneWireHotplugArmed;
+
+void EXTI7_0_IRQHandler(void) __attribute__((interrupt));
+void EXTI7_0_IRQHandler(void)
+{
+    if (EXTI->INTFR & ONEWIRE_EXTI_LINE) {
+        EXTI->INTFR = ONEWIRE_EXTI_LINE;
+        EXTI->INTENR &= ~ONEWIRE_EXTI_LINE;  // One event is enough until re-armed
+        oneWireHotplugArmed = false;
+        oneWireHotplugEvent = true;
+    }
+}
+
+// Route the data pin to its EXTI line, falling edge. Called by OneWireBegin().
+static inline void oneWireHotplugBegin(void)
+{
+    RCC->APB2PCENR |= RCC_APB2Periph_AFIO;
+    AFIO->EXTICR = (AFIO->EXTICR & ~(3u << (2 * ONEWIRE_PIN))) | (ONEWIRE_PORT_INDEX << (2 * ONEWIRE_PIN));
+    EXTI->FTENR |= ONEWIRE_EXTI_LINE;
+    EXTI->RTENR &= ~ONEWIRE_EXTI_LINE;
+    NVIC_EnableIRQ(EXTI7_0_IRQn);
+}
+
+// Start watching the idle bus. Cheap to call repeatedly.
+static inline void OneWireHotplugArm(void)
+{
+    if (oneWireHotplugArmed) return;
+    EXTI->INTFR = ONEWIRE_EXTI_LINE;          // Forget edges from our own traffic
+    EXTI->INTENR |= ONEWIRE_EXTI_LINE;
+    oneWireHotplugArmed = true;
+}
+
+// Stop watching, the bus is about to be used.
+static inline __attribute__((always_inline)) void OneWireHotplugDisarm(void)
+{
+    if (!oneWireHotplugArmed) return;
+    EXTI->INTENR &= ~ONEWIRE_EXTI_LINE;
+    oneWireHotplugArmed = false;
+}
+
+// Returns true once for every presence pulse seen on the idle bus.
+static inline bool OneWireHotplugPending(void)
+{
+    if (!oneWireHotplugEvent) return false;
+    oneWireHotplugEvent = false;
+    return true;
+}
+
+#else
+static inline void oneWireHotplugBegin(void) { }
+static inline void OneWireHotplugArm(void) { }
+static inline void OneWireHotplugDisarm(void) { }
+static inline bool OneWireHotplugPending(void) { return false; }
+#endif
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef OneWire_Timing_h
+#define OneWire_Timing_h
+
+// Slot timings of the bit-bang driver, included by OneWire_GPIO_Definitions.h.
+// No hardware dependencies, so BusPlanner.c and the host tools can use the
+// same numbers as the driver.
+
+// Timing profile, in microseconds. These are the standard speed slot
+// timings the driver has always used; override them as a set.
+#ifndef ONEWIRE_T_RESET_LOW
+#define ONEWIRE_T_RESET_LOW        480  // Reset pulse
+#define ONEWIRE_T_PRESENCE_SAMPLE   70  // Release to presence sample
+#define ONEWIRE_T_RESET_RECOVERY   410  // Presence sample to end of reset
+#define ONEWIRE_T_WRITE1_LOW        10  // Write 1 low time
+#define ONEWIRE_T_WRITE1_RECOVERY   55  // Write 1 rest of slot
+#define ONEWIRE_T_WRITE0_LOW        65  // Write 0 low time
+#define ONEWIRE_T_WRITE0_RECOVERY    5  // Write 0 rest of slot
+#define ONEWIRE_T_READ_LOW           3  // Read slot start pulse
+#define ONEWIRE_T_READ_SAMPLE       10  // Release to sample
+#define ONEWIRE_T_READ_RECOVERY     53  // Sample to end of slot
+#endif
+
+// Multi-sample read slots (ONEWIRE_READ_MULTISAMPLE). The first of three
+// samples lands ONEWIRE_T_READ_MARGIN after the measured bus rise time, the
+// last one no later than ONEWIRE_T_READ_LAST into the slot.
+#ifndef ONEWIRE_T_READ_MARGIN
+#define ONEWIRE_T_READ_MARGIN        2  // Measured rise time to first sample
+#define ONEWIRE_T_READ_SPACING       1  // Between samples
+#define ONEWIRE_T_READ_LAST         14  // Slot start to latest sample
+#endif
+
+// Check the profile against the 1-Wire spec at compile time.
+_Static_assert(ONEWIRE_T_RESET_LOW >= 480, "Reset pulse shorter than 480us");
+_Static_assert(ONEWIRE_T_PRESENCE_SAMPLE >= 60 && ONEWIRE_T_PRESENCE_SAMPLE <= 75, "Presence sample outside the presence pulse window");
+_Static_assert(ONEWIRE_T_PRESENCE_SAMPLE + ONEWIRE_T_RESET_RECOVERY >= 480, "Reset recovery shorter than 480us");
+_Static_assert(ONEWIRE_T_WRITE1_LOW >= 1 && ONEWIRE_T_WRITE1_LOW <= 15, "Write 1 low time outside 1..15us");
+_Static_assert(ONEWIRE_T_WRITE0_LOW >= 60 && ONEWIRE_T_WRITE0_LOW <= 120, "Write 0 low time outside 60..120us");
+_Static_assert(ONEWIRE_T_WRITE1_LOW + ONEWIRE_T_WRITE1_RECOVERY >= 60, "Write slot shorter than 60us");
+_Static_assert(ONEWIRE_T_READ_LOW + ONEWIRE_T_READ_SAMPLE <= 15, "Read sample later than 15us into the slot");
+_Static_assert(ONEWIRE_T_READ_LOW + ONEWIRE_T_READ_SAMPLE + ONEWIRE_T_READ_RECOVERY >= 60, "Read slot shorter than 60us");
+_Static_assert(ONEWIRE_T_READ_LAST <= 15, "Last read sample later than 15us into the slot");
+_Static_assert(ONEWIRE_T_READ_LOW + 1 + 2 * ONEWIRE_T_READ_SPACING <= ONEWIRE_T_READ_LAST, "No room for three read samples");
+
+#endif
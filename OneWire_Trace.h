@@ -0,0 +1,74 @@
+#ifndef OneWire_Trace_h
+#define OneWire_Trace_h
+#if !ONEWIRE_TRACE_HOST
+#include "ch32v003fun.h"
+#endif
+
+// Optional bus transaction tracer, included by OneWire.c.
+//
+// With ONEWIRE_TRACE (see OneWireConfig.h) set to 1 the reset and bit slot
+// functions record every edge they drive and every level they sample, with a
+// SysTick timestamp, in a bounded RAM ring that keeps the most recent
+// ONEWIRE_TRACE_DEPTH events.
+//
+// Tracing must not change the timing it records: inside a slot the hooks only
+// take a timestamp (ONEWIRE_TRACE_STAMP, one register load), and the events
+// are written to the ring (ONEWIRE_TRACE_EVENT) after the slot's timed part,
+// during recovery, where a few extra cycles only lengthen the idle time.
+// OneWireTraceDump.c turns the ring into a VCD file and slot timing margins.
+// With ONEWIRE_TRACE set to 0 the hooks compile to nothing.
+//
+// Golden traces: with ONEWIRE_TRACE_RAW the dump also logs the ring itself,
+// one "ticks event level" line per event. Such a capture, stored under
+// tools/golden/ with the VCD and margins it must produce, is replayed on the
+// host by `make trace-test` (tools/trace_replay.c defines ONEWIRE_TRACE_HOST
+// so this header builds without the MCU headers). The replay checks the dump
+// code against the stored output; it does not rerun the slot code, so it
+// catches changes in how a trace is converted and judged, not timing drift
+// in OneWire.c. The stored trace is generated from the nominal timings until
+// a board capture replaces it.
+
+#include <stdint.h>
+
+#ifndef ONEWIRE_TRACE_DEPTH
+#define ONEWIRE_TRACE_DEPTH 64   // Events kept, must be a power of two
+#endif
+
+// Event codes, the low bit of the level byte holds the driven or sampled level.
+#define ONEWIRE_TRACE_RESET_LOW       0  // Master starts the reset pulse
+#define ONEWIRE_TRACE_RESET_RELEASE   1  // Master releases the bus after the reset pulse
+#define ONEWIRE_TRACE_PRESENCE        2  // Presence sampled, level 0 means a device answered
+#define ONEWIRE_TRACE_WRITE_LOW       3  // Write slot starts, level is the bit written
+#define ONEWIRE_TRACE_WRITE_HIGH      4  // Master drives the bus high again
+#define ONEWIRE_TRACE_READ_LOW        5  // Read slot starts
+#define ONEWIRE_TRACE_READ_RELEASE    6  // Master releases the bus in a read slot
+#define ONEWIRE_TRACE_READ_SAMPLE     7  // Read slot sampled, level is the bit read
+
+#if ONEWIRE_TRACE
+
+#if (ONEWIRE_TRACE_DEPTH & (ONEWIRE_TRACE_DEPTH - 1)) != 0
+#error "ONEWIRE_TRACE_DEPTH must be a power of two"
+#endif
+
+uint32_t oneWireTraceTime[ONEWIRE_TRACE_DEPTH];
+uint8_t oneWireTraceEvent[ONEWIRE_TRACE_DEPTH];   // event << 1 | level
+uint16_t oneWireTraceHead;                         // Free running count of recorded events
+uint8_t oneWireTraceEnabled = 1;
+
+static inline __attribute__((always_inline))
+void oneWireTraceRecord(uint32_t time, uint8_t event, uint8_t level)
+{
+    if (!oneWireTraceEnabled) return;
+    uint16_t i = oneWireTraceHead++ & (ONEWIRE_TRACE_DEPTH - 1);
+    oneWireTraceTime[i] = time;
+    oneWireTraceEvent[i] = (event << 1) | (level & 1);
+}
+
+#define ONEWIRE_TRACE_STAMP(t) uint32_t t = SysTick->CNT
+#define ONEWIRE_TRACE_EVENT(t, event, level) oneWireTraceRecord((t), (event), (level))
+#else
+#define ONEWIRE_TRACE_STAMP(t) do { } while (0)
+#define ONEWIRE_TRACE_EVENT(t, event, level) do { } while (0)
+#endif
+
+#endif
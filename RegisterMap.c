@@ -0,0 +1,228 @@
+/**
+ * @file RegisterMap.c
+ * @brief Register map cache of the latest readings, served to an external host
+ * @license MIT License
+ * @details The node keeps the latest reading, its age and a status byte for every sensor
+ * in a flat byte-addressed register map. A host controller reads the map through a
+ * transport (I2C slave, see RegisterMapI2C.c) and always gets an immediate answer from
+ * the cache while conversions keep running in the background.
+ *
+ * Layout, multi-byte values little-endian:
+ *
+ *   0x00  ID        REGMAP_ID
+ *   0x01  VERSION   REGMAP_VERSION
+ *   0x02  COUNT     number of sensor blocks in use
+ *   0x03  FLAGS     REGMAP_FLAG_*
+ *   0x04  SEQUENCE  16-bit counter, incremented on every update
+ *   0x06  reserved
+ *   0x08  sensor blocks, REGMAP_BLOCK_SIZE bytes each, in sensor history slot order:
+ *         +0  ROM[8]
+ *         +8  RAW     Q4 temperature, int16; other families: the driver's value (FamilyDrivers.c)
+ *         +10 AGE     seconds since the reading, uint16, saturates
+ *         +12 STATUS  REGMAP_STATUS_*
+ *         +13 ERRORS  consecutive failed reads, saturates
+ *         +14 SAMPLES readings taken, uint16, wraps
+ *
+ * A host that needs a consistent block reads SEQUENCE, the block, then SEQUENCE again,
+ * and retries if it changed.
+ *
+ * The map itself has no hardware dependencies. A transport calls RegMapTransportStart()
+ * with the register pointer written by the host and RegMapTransportRead() for every byte
+ * the host clocks out, so the same calls can be driven from a Linux test harness by
+ * defining REGMAP_LOCK()/REGMAP_UNLOCK() before including this file.
+ *
+ * With ONEWIRE_REGMAP set to 0 (see OneWireConfig.h) the calls compile to nothing.
+ *
+ * Single-file module, included by temp-sensors.c the same way OneWire.c is.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef REGMAP_SENSORS
+#define REGMAP_SENSORS SENSOR_HISTORY_SLOTS
+#endif
+
+#ifndef REGMAP_LOCK
+#define REGMAP_LOCK()   __disable_irq()
+#define REGMAP_UNLOCK() __enable_irq()
+#endif
+
+#define REGMAP_ID 0xD5
+#define REGMAP_VERSION 1
+
+#define REGMAP_ADDR_ID 0x00
+#define REGMAP_ADDR_VERSION 0x01
+#define REGMAP_ADDR_COUNT 0x02
+#define REGMAP_ADDR_FLAGS 0x03
+#define REGMAP_ADDR_SEQUENCE 0x04
+#define REGMAP_ADDR_BLOCKS 0x08
+
+#define REGMAP_BLOCK_SIZE 16
+#define REGMAP_BLOCK_ROM 0
+#define REGMAP_BLOCK_RAW 8
+#define REGMAP_BLOCK_AGE 10
+#define REGMAP_BLOCK_STATUS 12
+#define REGMAP_BLOCK_ERRORS 13
+#define REGMAP_BLOCK_SAMPLES 14
+
+#define REGMAP_SIZE (REGMAP_ADDR_BLOCKS + REGMAP_SENSORS * REGMAP_BLOCK_SIZE)
+
+// Header flags
+#define REGMAP_FLAG_NO_SENSORS 0x01      // No sensor scheduled after the last search
+
+// Block status bits
+#define REGMAP_STATUS_VALID 0x01         // RAW holds a reading
+#define REGMAP_STATUS_READ_ERROR 0x02    // The most recent read failed, RAW is older
+#define REGMAP_STATUS_OUTLIER 0x04       // The most recent reading was rejected by the median filter, RAW is older
+
+#if ONEWIRE_REGMAP
+
+_Static_assert(REGMAP_SIZE <= 256, "Register map must fit an 8-bit register pointer");
+
+uint8_t regMap[REGMAP_SIZE];
+uint32_t regMapTimestamp[REGMAP_SENSORS]; // Time of the last reading, ms
+volatile uint8_t regMapPointer;
+
+static void regMapPut16(uint8_t addr, uint16_t v) {
+    regMap[addr] = v & 0xFF;
+    regMap[addr + 1] = v >> 8;
+}
+
+static uint16_t regMapGet16(uint8_t addr) {
+    return regMap[addr] | (regMap[addr + 1] << 8);
+}
+
+// Bump the sequence counter, called with the lock held.
+static void regMapTouch() {
+    regMapPut16(REGMAP_ADDR_SEQUENCE, regMapGet16(REGMAP_ADDR_SEQUENCE) + 1);
+}
+
+/**
+ * @brief Clear the register map.
+ */
+void RegMapBegin() {
+    REGMAP_LOCK();
+    memset(regMap, 0, sizeof(regMap));
+    regMap[REGMAP_ADDR_ID] = REGMAP_ID;
+    regMap[REGMAP_ADDR_VERSION] = REGMAP_VERSION;
+    REGMAP_UNLOCK();
+}
+
+/**
+ * @brief Publish the outcome of a read.
+ * @param slot The sensor history slot of the sensor, which is also its block index.
+ * @param rom The 8-byte address of the sensor.
+ * @param ok True if the read succeeded and 'raw' is valid.
+ * @param outlier True if the reading was rejected by the median filter. RAW keeps the last
+ * accepted reading, with its age and sample count, and only the OUTLIER bit is set.
+ * @param raw The reading in Q4.
+ * @param nowMs The current time in milliseconds.
+ */
+void RegMapUpdate(int8_t slot, const uint8_t rom[8], bool ok, bool outlier, int16_t raw, uint32_t nowMs) {
+    if (slot < 0 || slot >= REGMAP_SENSORS) {
+        return;
+    }
+    uint8_t base = REGMAP_ADDR_BLOCKS + slot * REGMAP_BLOCK_SIZE;
+
+    REGMAP_LOCK();
+    memcpy(&regMap[base + REGMAP_BLOCK_ROM], rom, 8);
+    uint8_t status = regMap[base + REGMAP_BLOCK_STATUS];
+    if (ok && outlier) {
+        regMap[base + REGMAP_BLOCK_ERRORS] = 0;
+        status = (status & ~REGMAP_STATUS_READ_ERROR) | REGMAP_STATUS_OUTLIER;
+    } else if (ok) {
+        regMapPut16(base + REGMAP_BLOCK_RAW, (uint16_t)raw);
+        regMapPut16(base + REGMAP_BLOCK_AGE, 0);
+        regMapPut16(base + REGMAP_BLOCK_SAMPLES, regMapGet16(base + REGMAP_BLOCK_SAMPLES) + 1);
+        regMap[base + REGMAP_BLOCK_ERRORS] = 0;
+        regMapTimestamp[slot] = nowMs;
+        status = (status | REGMAP_STATUS_VALID) & ~(REGMAP_STATUS_READ_ERROR | REGMAP_STATUS_OUTLIER);
+    } else {
+        if (regMap[base + REGMAP_BLOCK_ERRORS] < 0xFF) regMap[base + REGMAP_BLOCK_ERRORS]++;
+        status |= REGMAP_STATUS_READ_ERROR;
+    }
+    regMap[base + REGMAP_BLOCK_STATUS] = status;
+    if (regMap[REGMAP_ADDR_COUNT] <= slot) regMap[REGMAP_ADDR_COUNT] = slot + 1;
+    regMap[REGMAP_ADDR_FLAGS] &= ~REGMAP_FLAG_NO_SENSORS;
+    regMapTouch();
+    REGMAP_UNLOCK();
+}
+
+/**
+ * @brief Clear a sensor block, before a new sensor takes over its slot.
+ * @param slot The sensor history slot.
+ */
+void RegMapClear(int8_t slot) {
+    if (slot < 0 || slot >= REGMAP_SENSORS) {
+        return;
+    }
+    REGMAP_LOCK();
+    memset(&regMap[REGMAP_ADDR_BLOCKS + slot * REGMAP_BLOCK_SIZE], 0, REGMAP_BLOCK_SIZE);
+    regMapTouch();
+    REGMAP_UNLOCK();
+}
+
+/**
+ * @brief Set or clear header flags.
+ * @param flags The REGMAP_FLAG_* bits to change.
+ * @param set True to set them, false to clear them.
+ */
+void RegMapSetFlags(uint8_t flags, bool set) {
+    REGMAP_LOCK();
+    if (set) regMap[REGMAP_ADDR_FLAGS] |= flags;
+    else regMap[REGMAP_ADDR_FLAGS] &= ~flags;
+    REGMAP_UNLOCK();
+}
+
+/**
+ * @brief Refresh the age of every reading. Call regularly from the main loop.
+ * @param nowMs The current time in milliseconds.
+ */
+void RegMapService(uint32_t nowMs) {
+    for (uint8_t slot = 0; slot < regMap[REGMAP_ADDR_COUNT]; slot++) {
+        uint8_t base = REGMAP_ADDR_BLOCKS + slot * REGMAP_BLOCK_SIZE;
+        if (!(regMap[base + REGMAP_BLOCK_STATUS] & REGMAP_STATUS_VALID)) {
+            continue;
+        }
+        uint32_t age = (nowMs - regMapTimestamp[slot]) / 1000;
+        if (age > 0xFFFF) age = 0xFFFF;
+        if (age != regMapGet16(base + REGMAP_BLOCK_AGE)) {
+            REGMAP_LOCK();
+            regMapPut16(base + REGMAP_BLOCK_AGE, age);
+            REGMAP_UNLOCK();
+        }
+    }
+}
+
+/**
+ * @brief Transport hook: the host wrote a register pointer.
+ * @param addr The register address the following reads start at.
+ */
+void RegMapTransportStart(uint8_t addr) {
+    regMapPointer = addr;
+}
+
+/**
+ * @brief Transport hook: the host clocks out one byte.
+ * @return The byte at the register pointer, 0xFF past the end of the map.
+ * The pointer auto-increments. Safe to call from interrupt context.
+ */
+uint8_t RegMapTransportRead() {
+    uint8_t addr = regMapPointer;
+    regMapPointer = addr + 1;
+    return (addr < REGMAP_SIZE) ? regMap[addr] : 0xFF;
+}
+
+#else
+
+static inline void RegMapBegin() { }
+static inline void RegMapUpdate(int8_t slot, const uint8_t rom[8], bool ok, bool outlier, int16_t raw, uint32_t nowMs) {
+    (void)slot; (void)rom; (void)ok; (void)outlier; (void)raw; (void)nowMs;
+}
+static inline void RegMapClear(int8_t slot) { (void)slot; }
+static inline void RegMapSetFlags(uint8_t flags, bool set) { (void)flags; (void)set; }
+static inline void RegMapService(uint32_t nowMs) { (void)nowMs; }
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file RegisterMapI2C.c
+ * @brief I2C slave transport for the register map
+ * @license MIT License
+ * @details Serves RegisterMap.c on I2C1 (SCL on PC2, SDA on PC1) at REGMAP_I2C_ADDRESS.
+ *
+ * The host writes one byte to set the register pointer, then reads any number of bytes
+ * with a repeated start; the pointer auto-increments. Everything happens in the I2C
+ * interrupt, straight from the cache, so a host read never waits on the 1-Wire bus.
+ *
+ * Compiled out with ONEWIRE_REGMAP set to 0.
+ *
+ * Single-file module, included by temp-sensors.c the same way OneWire.c is.
+ */
+
+#include "ch32v003fun.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef REGMAP_I2C_ADDRESS
+#define REGMAP_I2C_ADDRESS 0x2A          // 7-bit slave address
+#endif
+
+#if ONEWIRE_REGMAP
+
+bool regMapI2CExpectPointer;
+
+void I2C1_EV_IRQHandler(void) __attribute__((interrupt));
+void I2C1_ER_IRQHandler(void) __attribute__((interrupt));
+
+/**
+ * @brief Start serving the register map as an I2C slave.
+ */
+void RegMapI2CBegin() {
+    RCC->APB2PCENR |= RCC_APB2Periph_GPIOC | RCC_APB2Periph_AFIO;
+    RCC->APB1PCENR |= RCC_APB1Periph_I2C1;
+
+    // PC1 (SDA) and PC2 (SCL) as alternate function open drain.
+    GPIOC->CFGLR &= ~((0xf << (4 * 1)) | (0xf << (4 * 2)));
+    GPIOC->CFGLR |= ((GPIO_Speed_10MHz | GPIO_CNF_OUT_OD_AF) << (4 * 1)) |
+                    ((GPIO_Speed_10MHz | GPIO_CNF_OUT_OD_AF) << (4 * 2));
+
+    RCC->APB1PRSTR |= RCC_APB1Periph_I2C1;
+    RCC->APB1PRSTR &= ~RCC_APB1Periph_I2C1;
+
+    I2C1->CTLR2 = (FUNCONF_SYSTEM_CORE_CLOCK / 1000000) | I2C_CTLR2_ITEVTEN | I2C_CTLR2_ITBUFEN | I2C_CTLR2_ITERREN;
+    I2C1->OADDR1 = REGMAP_I2C_ADDRESS << 1;
+    I2C1->CTLR1 = I2C_CTLR1_PE;
+    I2C1->CTLR1 |= I2C_CTLR1_ACK;
+
+    NVIC_EnableIRQ(I2C1_EV_IRQn);
+    NVIC_EnableIRQ(I2C1_ER_IRQn);
+}
+
+void I2C1_EV_IRQHandler(void) {
+    uint16_t star1 = I2C1->STAR1;
+
+    if (star1 & I2C_STAR1_ADDR) {
+        // Reading STAR2 after STAR1 clears ADDR. The first byte of a write is the pointer.
+        (void)I2C1->STAR2;
+        regMapI2CExpectPointer = true;
+    } else if (star1 & I2C_STAR1_RXNE) {
+        uint8_t b = I2C1->DATAR;
+        if (regMapI2CExpectPointer) {
+            RegMapTransportStart(b);
+            regMapI2CExpectPointer = false;
+        }
+        // Further written bytes are ignored, the map is read-only.
+    } else if (star1 & I2C_STAR1_TXE) {
+        I2C1->DATAR = RegMapTransportRead();
+    }
+
+    if (star1 & I2C_STAR1_STOPF) {
+        // Reading STAR1 then writing CTLR1 clears STOPF.
+        I2C1->CTLR1 |= I2C_CTLR1_PE;
+    }
+}
+
+void I2C1_ER_IRQHandler(void) {
+    // The master NACKs the last byte of a read; that and bus errors just end the transfer.
+    I2C1->STAR1 &= ~(I2C_STAR1_AF | I2C_STAR1_BERR | I2C_STAR1_OVR);
+}
+
+#else
+
+static inline void RegMapI2CBegin() { }
+
+#endif
@@ -0,0 +1,361 @@
+/**
+ * @file SensorHistory.c
+ * @brief Per-sensor reading history with delta encoding and running aggregates
+ * @license MIT License
+ * @details Keeps a small ring of timestamped readings for every sensor seen on the bus.
+ *
+ * Readings are raw Q4 values (1/16 degree C, as returned by the DS18x20 scratchpad).
+ * The oldest retained sample is kept as an anchor outside the ring, and every newer
+ * sample is stored as a record in a byte ring:
+ *
+ *   [0x81 lo hi]  optional: the sampling interval changed, new interval in history ticks
+ *   [0x80 lo hi]  absolute value, used when the change does not fit a one byte delta
+ *   [d]           signed one byte delta from the previous value (-126..127)
+ *
+ * Timestamps are implicit: each sample is assumed to follow the previous one by the
+ * current interval. Only when the real time drifts more than SENSOR_HISTORY_TIME_TOLERANCE
+ * ticks from that prediction is a new interval recorded. With a steady sweep rate a
+ * stored sample therefore costs a single byte.
+ *
+ * Single-file module, included by temp-sensors.c the same way OneWire.c is.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef SENSOR_HISTORY_SLOTS
+#define SENSOR_HISTORY_SLOTS 6           // Number of sensors tracked
+#endif
+
+#ifndef SENSOR_HISTORY_BYTES
+#define SENSOR_HISTORY_BYTES 24          // Ring size per sensor, roughly one byte per sample
+#endif
+
+#define SENSOR_HISTORY_TICK_SHIFT 4      // One history tick is 16 ms
+#define SENSOR_HISTORY_TIME_TOLERANCE 2  // Ticks of timing jitter absorbed before recording a new interval
+#define SENSOR_HISTORY_MEDIAN_LEN 5      // Samples in the median filter window
+#define SENSOR_HISTORY_OUTLIER_Q4 (5 * 16) // Reject samples more than 5C away from the median
+
+#define SENSOR_HISTORY_ESC_ABSOLUTE 0x80
+#define SENSOR_HISTORY_ESC_INTERVAL 0x81
+
+typedef struct {
+    uint32_t timeMs;                     // Timestamp in milliseconds (16 ms resolution)
+    int16_t raw;                         // Q4 temperature, 1/16 C per count
+} SensorSample;
+
+typedef struct {
+    int16_t min;                         // Lowest accepted value, Q4
+    int16_t max;                         // Highest accepted value, Q4
+    int16_t mean;                        // Mean of accepted values, Q4
+    int16_t median;                      // Output of the median filter, Q4
+    uint16_t outliers;                   // Samples rejected by the median filter
+    uint8_t samples;                     // Samples currently held in the history
+} SensorAggregates;
+
+typedef struct {
+    uint8_t rom[8];
+    bool used;
+
+    // Byte ring of encoded records, newest at head
+    uint8_t ring[SENSOR_HISTORY_BYTES];
+    uint8_t head;
+    uint8_t tail;
+    uint8_t fill;
+    uint8_t samples;
+
+    // Decoder state at the oldest sample (the anchor, not stored in the ring)
+    int16_t tailValue;
+    uint32_t tailTime;
+    uint16_t tailInterval;
+
+    // Encoder state at the newest sample
+    int16_t headValue;
+    uint32_t headTime;
+    uint16_t headInterval;
+
+    // Running aggregates
+    int16_t min;
+    int16_t max;
+    int32_t sum;
+    uint16_t count;
+
+    // Median filter
+    int16_t medianWindow[SENSOR_HISTORY_MEDIAN_LEN];
+    uint8_t medianNext;
+    uint8_t medianFill;
+    uint16_t outliers;
+} SensorHistory;
+
+SensorHistory sensorHistory[SENSOR_HISTORY_SLOTS];
+
+/**
+ * @brief Find the history slot of a sensor.
+ * @param rom The 8-byte address of the sensor.
+ * @return The slot index, or -1 if the sensor has no history.
+ */
+int8_t SensorHistoryFind(const uint8_t rom[8]) {
+    for (uint8_t i = 0; i < SENSOR_HISTORY_SLOTS; i++) {
+        if (sensorHistory[i].used && memcmp(sensorHistory[i].rom, rom, 8) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Find or allocate the history slot of a sensor.
+ * @param rom The 8-byte address of the sensor.
+ * @return The slot index, or -1 if all slots are taken.
+ */
+int8_t SensorHistorySlot(const uint8_t rom[8]) {
+    int8_t slot = SensorHistoryFind(rom);
+    if (slot >= 0) {
+        return slot;
+    }
+    for (uint8_t i = 0; i < SENSOR_HISTORY_SLOTS; i++) {
+        if (!sensorHistory[i].used) {
+            memset(&sensorHistory[i], 0, sizeof(SensorHistory));
+            memcpy(sensorHistory[i].rom, rom, 8);
+            sensorHistory[i].used = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Free the history slot of a sensor, e.g. one that left the bus.
+ * @param rom The 8-byte address of the sensor.
+ * The slot and its samples go to the next new sensor.
+ */
+void SensorHistoryRemove(const uint8_t rom[8]) {
+    int8_t slot = SensorHistoryFind(rom);
+    if (slot >= 0) {
+        sensorHistory[slot].used = false;
+    }
+}
+
+static uint8_t sensorHistoryPeek(SensorHistory *h, uint8_t offset) {
+    uint8_t pos = h->tail + offset;
+    if (pos >= SENSOR_HISTORY_BYTES) pos -= SENSOR_HISTORY_BYTES;
+    return h->ring[pos];
+}
+
+static void sensorHistoryPush(SensorHistory *h, uint8_t b) {
+    h->ring[h->head] = b;
+    if (++h->head == SENSOR_HISTORY_BYTES) h->head = 0;
+    h->fill++;
+}
+
+/**
+ * Decode the record at byte offset 'pos' from the tail, advancing the given decoder state.
+ * Returns the length of the record in bytes.
+ */
+static uint8_t sensorHistoryDecode(SensorHistory *h, uint8_t pos, int16_t *value, uint32_t *time, uint16_t *interval) {
+    uint8_t len = 0;
+    uint8_t b = sensorHistoryPeek(h, pos);
+
+    if (b == SENSOR_HISTORY_ESC_INTERVAL) {
+        *interval = sensorHistoryPeek(h, pos + 1) | (sensorHistoryPeek(h, pos + 2) << 8);
+        len = 3;
+        b = sensorHistoryPeek(h, pos + len);
+    }
+    if (b == SENSOR_HISTORY_ESC_ABSOLUTE) {
+        *value = (int16_t)(sensorHistoryPeek(h, pos + len + 1) | (sensorHistoryPeek(h, pos + len + 2) << 8));
+        len += 3;
+    } else {
+        *value += (int8_t)b;
+        len += 1;
+    }
+    *time += *interval;
+    return len;
+}
+
+// Drop the oldest record so the sample after it becomes the new anchor.
+static void sensorHistoryEvict(SensorHistory *h) {
+    uint8_t len = sensorHistoryDecode(h, 0, &h->tailValue, &h->tailTime, &h->tailInterval);
+    h->tail += len;
+    if (h->tail >= SENSOR_HISTORY_BYTES) h->tail -= SENSOR_HISTORY_BYTES;
+    h->fill -= len;
+    h->samples--;
+}
+
+static int16_t sensorHistoryMedian(const SensorHistory *h) {
+    int16_t sorted[SENSOR_HISTORY_MEDIAN_LEN];
+    uint8_t n = h->medianFill;
+
+    // Insertion sort, the window is tiny.
+    for (uint8_t i = 0; i < n; i++) {
+        int16_t v = h->medianWindow[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return sorted[n / 2];
+}
+
+/**
+ * @brief Store a new reading for a sensor.
+ * @param rom The 8-byte address of the sensor.
+ * @param raw The reading in Q4 (1/16 C).
+ * @param nowMs The current time in milliseconds.
+ * @return True if the reading was stored, false if it was rejected as an outlier or no slot is free.
+ * The reading always enters the median filter, so a genuine step change is accepted once
+ * the median catches up with it.
+ */
+bool SensorHistoryAdd(const uint8_t rom[8], int16_t raw, uint32_t nowMs) {
+    int8_t slot = SensorHistorySlot(rom);
+    if (slot < 0) {
+        return false;
+    }
+    SensorHistory *h = &sensorHistory[slot];
+    uint32_t now = nowMs >> SENSOR_HISTORY_TICK_SHIFT;
+
+    // Outlier check against the filter state before this sample.
+    bool outlier = false;
+    if (h->medianFill >= 3) {
+        int16_t diff = raw - sensorHistoryMedian(h);
+        if (diff > SENSOR_HISTORY_OUTLIER_Q4 || diff < -SENSOR_HISTORY_OUTLIER_Q4) {
+            outlier = true;
+        }
+    }
+    h->medianWindow[h->medianNext] = raw;
+    if (++h->medianNext == SENSOR_HISTORY_MEDIAN_LEN) h->medianNext = 0;
+    if (h->medianFill < SENSOR_HISTORY_MEDIAN_LEN) h->medianFill++;
+
+    if (outlier) {
+        h->outliers++;
+        return false;
+    }
+
+    if (h->samples == 0) {
+        // First sample becomes the anchor.
+        h->tailValue = h->headValue = raw;
+        h->tailTime = h->headTime = now;
+        h->tailInterval = h->headInterval = 0;
+        h->head = h->tail = h->fill = 0;
+        h->min = h->max = raw;
+        h->sum = 0;
+        h->count = 0;
+    } else {
+        // Encode the record, at most 6 bytes.
+        uint8_t record[6];
+        uint8_t len = 0;
+        uint32_t predicted = h->headTime + h->headInterval;
+        int32_t drift = (int32_t)(now - predicted);
+
+        if (drift > SENSOR_HISTORY_TIME_TOLERANCE || drift < -SENSOR_HISTORY_TIME_TOLERANCE) {
+            uint32_t interval = now - h->headTime;
+            if (interval > 0xFFFF) interval = 0xFFFF;
+            h->headInterval = interval;
+            record[len++] = SENSOR_HISTORY_ESC_INTERVAL;
+            record[len++] = interval & 0xFF;
+            record[len++] = interval >> 8;
+        }
+        h->headTime += h->headInterval;
+
+        int16_t delta = raw - h->headValue;
+        if (delta >= -126 && delta <= 127) {
+            record[len++] = (uint8_t)(int8_t)delta;
+        } else {
+            record[len++] = SENSOR_HISTORY_ESC_ABSOLUTE;
+            record[len++] = (uint16_t)raw & 0xFF;
+            record[len++] = (uint16_t)raw >> 8;
+        }
+        h->headValue = raw;
+
+        while (SENSOR_HISTORY_BYTES - h->fill < len) {
+            sensorHistoryEvict(h);
+        }
+        for (uint8_t i = 0; i < len; i++) {
+            sensorHistoryPush(h, record[i]);
+        }
+    }
+    h->samples++;
+
+    if (raw < h->min) h->min = raw;
+    if (raw > h->max) h->max = raw;
+    if (h->count == 0xFFFF) {
+        // Keep the mean running without overflowing, older samples fade out.
+        h->sum /= 2;
+        h->count /= 2;
+    }
+    h->sum += raw;
+    h->count++;
+    return true;
+}
+
+/**
+ * @brief Fetch the most recent readings of a sensor in one call.
+ * @param slot The history slot, see SensorHistoryFind().
+ * @param out Array receiving the samples, oldest first.
+ * @param maxSamples The capacity of 'out'.
+ * @return The number of samples written.
+ */
+uint8_t SensorHistoryFetch(int8_t slot, SensorSample *out, uint8_t maxSamples) {
+    if (slot < 0 || slot >= SENSOR_HISTORY_SLOTS || !sensorHistory[slot].used) {
+        return 0;
+    }
+    SensorHistory *h = &sensorHistory[slot];
+    uint8_t skip = (h->samples > maxSamples) ? h->samples - maxSamples : 0;
+    uint8_t written = 0;
+
+    int16_t value = h->tailValue;
+    uint32_t time = h->tailTime;
+    uint16_t interval = h->tailInterval;
+    uint8_t pos = 0;
+
+    for (uint8_t i = 0; i < h->samples; i++) {
+        if (i > 0) {
+            pos += sensorHistoryDecode(h, pos, &value, &time, &interval);
+        }
+        if (i >= skip) {
+            out[written].timeMs = time << SENSOR_HISTORY_TICK_SHIFT;
+            out[written].raw = value;
+            written++;
+        }
+    }
+    return written;
+}
+
+/**
+ * @brief Get the running aggregates of a sensor.
+ * @param slot The history slot, see SensorHistoryFind().
+ * @param agg Receives min, max, mean, the median filter output and counters.
+ * @return True if the slot holds at least one sample.
+ */
+bool SensorHistoryAggregates(int8_t slot, SensorAggregates *agg) {
+    if (slot < 0 || slot >= SENSOR_HISTORY_SLOTS || !sensorHistory[slot].used || sensorHistory[slot].count == 0) {
+        return false;
+    }
+    SensorHistory *h = &sensorHistory[slot];
+    int32_t half = h->count / 2;
+
+    agg->min = h->min;
+    agg->max = h->max;
+    agg->mean = (h->sum >= 0) ? (h->sum + half) / h->count : (h->sum - half) / h->count;
+    agg->median = sensorHistoryMedian(h);
+    agg->outliers = h->outliers;
+    agg->samples = h->samples;
+    return true;
+}
+
+/**
+ * @brief Get the latest stored reading of a sensor.
+ * @param slot The history slot, see SensorHistoryFind().
+ * @param sample Receives the newest sample.
+ * @return True if the slot holds at least one sample.
+ */
+bool SensorHistoryLatest(int8_t slot, SensorSample *sample) {
+    if (slot < 0 || slot >= SENSOR_HISTORY_SLOTS || !sensorHistory[slot].used || sensorHistory[slot].samples == 0) {
+        return false;
+    }
+    sample->timeMs = sensorHistory[slot].headTime << SENSOR_HISTORY_TICK_SHIFT;
+    sample->raw = sensorHistory[slot].headValue;
+    return true;
+}
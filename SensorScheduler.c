@@ -0,0 +1,402 @@
+/**
+ * @file SensorScheduler.c
+ * @brief Per-sensor sampling policies and priority scheduling of bus transactions
+ * @license MIT License
+ * @details Decides which sensor the state machine in temp-sensors.c services next.
+ *
+ * Every sensor has a policy:
+ *  - SCHED_POLICY_FIXED     sample every periodMs.
+ *  - SCHED_POLICY_ADAPTIVE  halve the period while the value is moving, stretch it by a
+ *                           quarter while it is stable, within the class limits.
+ * and a priority class (critical, normal, background) that sets its default period and
+ * wins ties when several sensors are due at once.
+ *
+ * Conversions overlap: a sensor converting does not hold the bus, so while one sensor
+ * converts the scheduler starts conversions on others and reads whichever finishes first.
+ * The bus is only busy for the short request and read transactions, which is what lets
+ * critical sensors get sub-second updates on a bus shared with many slow ones.
+ *
+ * With ONEWIRE_ASYNC set to 0 (see OneWireConfig.h) policies, priorities and overlapping
+ * are compiled out: one sensor converts at a time, each every SCHED_FIXED_PERIOD_MS.
+ *
+ * With DS2409 branches (ONEWIRE_COUPLER, see BranchCoupler.c) sensors reachable without a
+ * branch switch go first, and while sensors on the connected branch are converting the
+ * others wait, so each branch is converted and read as one batch. The batch is bounded:
+ * once a sensor on another branch is due, no new conversion starts on the connected one,
+ * the running ones are read and then the bus switches. Critical sensors do not wait and
+ * do not hold a branch.
+ *
+ * With ONEWIRE_LOWPOWER (see LowPower.c) a due sensor that converts triggers a broadcast
+ * conversion instead: every converting device on the bus starts at once, so a whole sweep
+ * shares one conversion wait that the MCU can sleep through.
+ *
+ * Entries share their index with the sensor history slot of the same ROM.
+ *
+ * Single-file module, included by temp-sensors.c the same way OneWire.c is.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define SCHED_POLICY_FIXED 0
+#define SCHED_POLICY_ADAPTIVE 1
+
+#define SCHED_PRIORITY_CRITICAL 0
+#define SCHED_PRIORITY_NORMAL 1
+#define SCHED_PRIORITY_BACKGROUND 2
+
+#define SCHED_ACTION_NONE 0              // Nothing due, the bus is idle
+#define SCHED_ACTION_CONVERT 1           // Start a conversion on the returned slot
+#define SCHED_ACTION_READ 2              // Read the finished conversion of the returned slot
+#define SCHED_ACTION_CONVERT_ALL 3       // Broadcast a conversion, the returned slot is due
+
+#define SCHED_IDLE 0
+#define SCHED_CONVERTING 1
+
+#define SCHED_CHANGE_Q4 2                // A change of 1/8 C or more counts as moving
+#define SCHED_MAX_FAILURES 3             // Consecutive failed reads before a sensor is dropped
+#define SCHED_DEFAULT_CONVERSION_MS 750  // 12 bit conversion, until the resolution is known
+#define SCHED_FIXED_PERIOD_MS 1000       // Sample period without ONEWIRE_ASYNC
+
+#if ONEWIRE_ASYNC
+// Default period and adaptive limits per priority class, in milliseconds.
+static const uint32_t schedClassPeriod[3] = { 500, 5000, 30000 };
+static const uint32_t schedClassMinPeriod[3] = { 100, 1000, 5000 };
+static const uint32_t schedClassMaxPeriod[3] = { 1000, 60000, 300000 };
+
+typedef struct {
+    uint8_t rom[8];
+    uint8_t policy;
+    uint8_t priority;
+    uint32_t periodMs;                   // 0 uses the class default
+} SchedPolicy;
+
+// Per-ROM policies, terminated by an entry with family code 0.
+// Sensors not listed here are adaptive and normal priority.
+static const SchedPolicy schedPolicies[] = {
+    // { { 0x28, 0xFF, 0x64, 0x1E, 0x0F, 0x16, 0x03, 0x90 }, SCHED_POLICY_FIXED, SCHED_PRIORITY_CRITICAL, 250 },
+    { { 0 }, SCHED_POLICY_ADAPTIVE, SCHED_PRIORITY_NORMAL, 0 },
+};
+#endif
+
+typedef struct {
+    bool used;
+    uint8_t state;
+    uint8_t failures;
+#if ONEWIRE_ASYNC
+    uint8_t policy;
+    uint8_t priority;
+    bool hasLast;
+    int16_t lastRaw;
+#endif
+    uint16_t conversionMs;
+    uint32_t periodMs;
+    uint32_t dueMs;                      // When the next conversion should start
+    uint32_t startMs;                    // When the current conversion started
+} SchedEntry;
+
+SchedEntry schedEntries[SENSOR_HISTORY_SLOTS];
+
+/**
+ * @brief Add a sensor to the schedule, applying its policy. Does nothing if already scheduled.
+ * @param rom The 8-byte address of the sensor.
+ * @param nowMs The current time in milliseconds.
+ * @return The slot of the sensor, or -1 if the tables are full.
+ */
+int8_t SchedulerAdd(const uint8_t rom[8], uint32_t nowMs) {
+    int8_t slot = SensorHistorySlot(rom);
+    if (slot < 0 || schedEntries[slot].used) {
+        return slot;
+    }
+    SchedEntry *e = &schedEntries[slot];
+    memset(e, 0, sizeof(SchedEntry));
+    e->used = true;
+#if ONEWIRE_ASYNC
+    e->policy = SCHED_POLICY_ADAPTIVE;
+    e->priority = SCHED_PRIORITY_NORMAL;
+
+    for (const SchedPolicy *p = schedPolicies; p->rom[0]; p++) {
+        if (memcmp(p->rom, rom, 8) == 0) {
+            e->policy = p->policy;
+            e->priority = p->priority;
+            e->periodMs = p->periodMs;
+            break;
+        }
+    }
+    if (e->periodMs == 0) {
+        e->periodMs = schedClassPeriod[e->priority];
+    }
+#else
+    e->periodMs = SCHED_FIXED_PERIOD_MS;
+#endif
+    e->conversionMs = SCHED_DEFAULT_CONVERSION_MS;
+    e->dueMs = nowMs;
+    return slot;
+}
+
+/**
+ * @brief Number of sensors currently scheduled.
+ */
+uint8_t SchedulerCount() {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < SENSOR_HISTORY_SLOTS; i++) {
+        if (schedEntries[i].used) n++;
+    }
+    return n;
+}
+
+#if ONEWIRE_COUPLER
+// True if servicing the entry needs no branch switch.
+static bool schedOnActiveBranch(const SchedEntry *e) {
+    uint8_t branch = CouplerBranchOf(e - schedEntries);
+    return branch == COUPLER_TRUNK || branch == CouplerActive();
+}
+
+// True if the entry takes part in branch batches: on a branch and not critical.
+static bool schedBatched(const SchedEntry *e) {
+#if ONEWIRE_ASYNC
+    if (e->priority == SCHED_PRIORITY_CRITICAL) {
+        return false;
+    }
+#endif
+    return CouplerBranchOf(e - schedEntries) != COUPLER_TRUNK;
+}
+
+// True if the entry has to wait for the batch on the connected branch to finish.
+static bool schedWaitsForBranch(const SchedEntry *e, bool branchBusy) {
+    return branchBusy && schedBatched(e) && !schedOnActiveBranch(e);
+}
+
+// True if the entry must not start converting because the connected branch is draining.
+static bool schedHeldForSwitch(const SchedEntry *e, bool switchDue) {
+    return switchDue && schedBatched(e) && schedOnActiveBranch(e);
+}
+#else
+static inline bool schedWaitsForBranch(const SchedEntry *e, bool branchBusy) {
+    (void)e;
+    (void)branchBusy;
+    return false;
+}
+
+static inline bool schedHeldForSwitch(const SchedEntry *e, bool switchDue) {
+    (void)e;
+    (void)switchDue;
+    return false;
+}
+#endif
+
+// True if entry a should be serviced before entry b, given their deadlines.
+static bool schedBefore(const SchedEntry *a, uint32_t aDeadline, const SchedEntry *b, uint32_t bDeadline) {
+#if ONEWIRE_ASYNC
+    if (a->priority != b->priority) {
+        return a->priority < b->priority;
+    }
+#endif
+#if ONEWIRE_COUPLER
+    if (schedOnActiveBranch(a) != schedOnActiveBranch(b)) {
+        return schedOnActiveBranch(a);
+    }
+#endif
+    (void)a;
+    (void)b;
+    return (int32_t)(aDeadline - bDeadline) < 0;
+}
+
+#if ONEWIRE_LOWPOWER
+// True if the sensor in this slot starts converting on a broadcast Convert T (0x44).
+static bool schedConvertsOnBroadcast(uint8_t slot) {
+    const FamilyDriver *d = FamilyDriverFind(sensorHistory[slot].rom[0]);
+    return d && d->convert;
+}
+#endif
+
+/**
+ * @brief Pick the next bus transaction.
+ * @param nowMs The current time in milliseconds.
+ * @param slot Receives the slot to service.
+ * @return One of SCHED_ACTION_NONE, SCHED_ACTION_CONVERT, SCHED_ACTION_CONVERT_ALL or
+ * SCHED_ACTION_READ.
+ * Finished conversions are read first, since they complete a sample. Otherwise the most
+ * important overdue sensor starts converting.
+ */
+uint8_t SchedulerNext(uint32_t nowMs, int8_t *slot) {
+    int8_t best = -1;
+    uint32_t bestDeadline = 0;
+    bool converting = false;
+    bool branchBusy = false;             // A sensor on the connected branch is converting
+    bool switchDue = false;              // A sensor on another branch is due
+
+#if ONEWIRE_COUPLER
+    for (uint8_t i = 0; i < SENSOR_HISTORY_SLOTS; i++) {
+        SchedEntry *e = &schedEntries[i];
+        if (!e->used || !schedBatched(e)) {
+            continue;
+        }
+        if (e->state == SCHED_CONVERTING && schedOnActiveBranch(e)) {
+            branchBusy = true;
+        }
+        if (e->state == SCHED_IDLE && !schedOnActiveBranch(e) && (int32_t)(nowMs - e->dueMs) >= 0) {
+            switchDue = true;
+        }
+    }
+#endif
+
+    for (uint8_t i = 0; i < SENSOR_HISTORY_SLOTS; i++) {
+        SchedEntry *e = &schedEntries[i];
+        uint32_t ready = e->startMs + e->conversionMs;
+        if (e->used && e->state == SCHED_CONVERTING) {
+            converting = true;
+            if (schedWaitsForBranch(e, branchBusy)) {
+                continue;
+            }
+            if ((int32_t)(nowMs - ready) >= 0 && (best < 0 || schedBefore(e, ready, &schedEntries[best], bestDeadline))) {
+                best = i;
+                bestDeadline = ready;
+            }
+        }
+    }
+    if (best >= 0) {
+        *slot = best;
+        return SCHED_ACTION_READ;
+    }
+    if (!ONEWIRE_ASYNC && converting) {
+        return SCHED_ACTION_NONE; // One conversion at a time.
+    }
+
+    for (uint8_t i = 0; i < SENSOR_HISTORY_SLOTS; i++) {
+        SchedEntry *e = &schedEntries[i];
+        if (e->used && e->state == SCHED_IDLE && (int32_t)(nowMs - e->dueMs) >= 0
+            && !schedWaitsForBranch(e, branchBusy) && !schedHeldForSwitch(e, switchDue)) {
+            if (best < 0 || schedBefore(e, e->dueMs, &schedEntries[best], bestDeadline)) {
+                best = i;
+                bestDeadline = e->dueMs;
+            }
+        }
+    }
+    if (best >= 0) {
+        *slot = best;
+#if ONEWIRE_LOWPOWER
+        if (schedConvertsOnBroadcast(best)) {
+            return SCHED_ACTION_CONVERT_ALL;
+        }
+#endif
+        return SCHED_ACTION_CONVERT;
+    }
+    return SCHED_ACTION_NONE;
+}
+
+/**
+ * @brief Record that a conversion was started.
+ * @param slot The slot of the sensor.
+ * @param nowMs The current time in milliseconds.
+ */
+void SchedulerConverting(int8_t slot, uint32_t nowMs) {
+    schedEntries[slot].state = SCHED_CONVERTING;
+    schedEntries[slot].startMs = nowMs;
+}
+
+#if ONEWIRE_LOWPOWER
+/**
+ * @brief Record that a broadcast conversion was started.
+ * @param nowMs The current time in milliseconds.
+ * @return The number of sensors now converting.
+ * Every idle sensor that converts and is reachable without a branch switch starts now,
+ * due or not, which lines their cadences up on the same sweep.
+ */
+uint8_t SchedulerConvertingAll(uint32_t nowMs) {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < SENSOR_HISTORY_SLOTS; i++) {
+        SchedEntry *e = &schedEntries[i];
+        if (e->used && e->state == SCHED_IDLE && schedConvertsOnBroadcast(i)
+#if ONEWIRE_COUPLER
+            && schedOnActiveBranch(e)
+#endif
+        ) {
+            SchedulerConverting(i, nowMs);
+            n++;
+        }
+    }
+    return n;
+}
+#endif
+
+/**
+ * @brief Time until the scheduler has something to do.
+ * @param nowMs The current time in milliseconds.
+ * @return Milliseconds until the next conversion finishes or the next sensor is due,
+ * 0 if something is already pending, UINT32_MAX if no sensor is scheduled.
+ */
+uint32_t SchedulerIdleMs(uint32_t nowMs) {
+    uint32_t idle = UINT32_MAX;
+    for (uint8_t i = 0; i < SENSOR_HISTORY_SLOTS; i++) {
+        SchedEntry *e = &schedEntries[i];
+        if (!e->used) {
+            continue;
+        }
+        uint32_t at = (e->state == SCHED_CONVERTING) ? e->startMs + e->conversionMs : e->dueMs;
+        int32_t left = (int32_t)(at - nowMs);
+        if (left <= 0) {
+            return 0;
+        }
+        if ((uint32_t)left < idle) {
+            idle = left;
+        }
+    }
+    return idle;
+}
+
+/**
+ * @brief Record the outcome of a read and plan the next sample.
+ * @param slot The slot of the sensor.
+ * @param ok True if the read succeeded.
+ * @param raw The reading in Q4, ignored on failure.
+ * @param conversionMs The conversion time for the sensor's resolution.
+ * @param nowMs The current time in milliseconds.
+ * After SCHED_MAX_FAILURES failed reads in a row the sensor is dropped and its history
+ * slot freed; the next discovery pass adds it back if it is still on the bus.
+ */
+void SchedulerReadDone(int8_t slot, bool ok, int16_t raw, uint16_t conversionMs, uint32_t nowMs) {
+    SchedEntry *e = &schedEntries[slot];
+    e->state = SCHED_IDLE;
+
+    if (!ok) {
+        if (++e->failures >= SCHED_MAX_FAILURES) {
+            e->used = false;
+            SensorHistoryRemove(sensorHistory[slot].rom);
+        } else {
+#if ONEWIRE_ASYNC
+            e->dueMs = nowMs + schedClassMinPeriod[e->priority];
+#else
+            e->dueMs = nowMs + SCHED_FIXED_PERIOD_MS;
+#endif
+        }
+        return;
+    }
+    e->failures = 0;
+    e->conversionMs = conversionMs;
+
+#if ONEWIRE_ASYNC
+    if (e->policy == SCHED_POLICY_ADAPTIVE && e->hasLast) {
+        int16_t change = raw - e->lastRaw;
+        if (change < 0) change = -change;
+        if (change >= SCHED_CHANGE_Q4) {
+            e->periodMs /= 2;
+            if (e->periodMs < schedClassMinPeriod[e->priority]) e->periodMs = schedClassMinPeriod[e->priority];
+        } else {
+            e->periodMs += e->periodMs / 4;
+            if (e->periodMs > schedClassMaxPeriod[e->priority]) e->periodMs = schedClassMaxPeriod[e->priority];
+        }
+    }
+    e->lastRaw = raw;
+    e->hasLast = true;
+#else
+    (void)raw;
+#endif
+
+    // Keep the cadence anchored to the conversion start, catch up if late.
+    e->dueMs = e->startMs + e->periodMs;
+    if ((int32_t)(nowMs - e->dueMs) > 0) {
+        e->dueMs = nowMs;
+    }
+}
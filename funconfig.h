@@ -1,8 +1,9 @@
 #ifndef _FUNCONFIG_H
 #define _FUNCONFIG_H
 
-// Though this should be on by default we can extra force it on.
-#define FUNCONF_USE_DEBUGPRINTF 1
+// Log output goes through LogOutput.c (USART1 TX DMA on PD5), so the
+// blocking debug printf channel is turned off.
+#define FUNCONF_USE_DEBUGPRINTF 0
 // #define FUNCONF_DEBUGPRINTF_TIMEOUT (1<<31) // Wait for a very very long time.
 
 #define FUNCONF_USE_HSE 1               // Use External Oscillator
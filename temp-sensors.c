@@ -7,23 +7,51 @@
  */
 
 #include "ch32v003fun.h"
-#include "ch32v003_GPIO_branchless.h"
-#include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 
 #include "OneWire.c"
+#include "SensorHistory.c"
+#include "LogOutput.c"
+#include "OneWireTraceDump.c"
+#include "RegisterMap.c"
+#include "RegisterMapI2C.c"
+#include "BranchCoupler.c"
+#include "FamilyDrivers.c"
+#include "SensorScheduler.c"
+#include "LowPower.c"
+#include "BusPlanner.c"
 
-#define TEMP_READ_DELAY (FUNCONF_SYSTEM_CORE_CLOCK/32) // roughly one second
+#define DISCOVERY_INTERVAL_MS 60000 // Without hot-plug detection, search the bus for added sensors once a minute
+// With it, still search every ten minutes: a presence pulse sent while the bus was busy is
+// missed, and sensors the scheduler dropped only come back through a discovery pass.
+#define DISCOVERY_HOTPLUG_INTERVAL_MS (10 * DISCOVERY_INTERVAL_MS)
+#if ONEWIRE_HOTPLUG
+#define DISCOVERY_PERIOD_MS DISCOVERY_HOTPLUG_INTERVAL_MS
+#else
+#define DISCOVERY_PERIOD_MS DISCOVERY_INTERVAL_MS
+#endif
+
+// Fast scratchpad reads (ONEWIRE_FAST_READ): only the two temperature bytes are clocked in
+// and the rest of the transfer is aborted with a reset. Without the CRC the reading has to
+// pass plausibility checks, otherwise a full CRC-checked read is done instead.
+#define FAST_READ_FULL_EVERY 16       // Fast reads between full reads, keeps the configuration current
+#define FAST_READ_MAX_RATE_Q4 32      // Largest believable change, 2 C per second
+#define FAST_READ_MARGIN_Q4 8         // Allowed on top of the rate bound, 0.5 C
+
+// A scratchpad with a bad CRC is read again before giving up. The conversion result stays in
+// the scratchpad, so a retry costs one read instead of a new conversion cycle.
+#define SCRATCHPAD_READ_RETRIES 1
 
 // Constants for states
 #define FIND_SENSOR 0
 #define VALIDATE_ADDRESS 1
 #define PRINT_SENSOR_TYPE 2
 #define REQUEST_TEMPERATURE 3
-#define WAIT_FOR_SENSOR_READ 4
+#define SCHEDULE_NEXT 4
 #define READ_TEMPERATURE_DATA 5
 #define PRINT_TEMPERATURE_DATA 6
+#define REQUEST_ALL_TEMPERATURES 7
 
 // Function prototypes
 /**
@@ -31,11 +59,15 @@
  */
 void initializeHardware();
 /**
- * @brief Find the next DS18x20 sensor on the one-wire bus.
- * @param address The 8-byte address of the found sensor.
- * @return True if a sensor is found, false otherwise.
+ * @brief Find the next supported device on the one-wire bus.
+ * @param address The 8-byte address of the found device.
+ * @return True if a device is found, false otherwise.
  */
 bool findNextSensor(uint8_t address[8]);
+/**
+ * @brief Start the next findNextSensor() pass from the first sensor again.
+ */
+void resetSensorSearch();
 /**
  * @brief Validate the CRC of the sensor's address.
  * @param address The 8-byte address of the sensor.
@@ -43,8 +75,8 @@ bool findNextSensor(uint8_t address[8]);
  */
 bool validateAddressCRC(uint8_t address[8]);
 /**
- * @brief Print the type of DS18x20 sensor based on its address.
- * @param address The 8-byte address of the sensor.
+ * @brief Print the device type based on its address.
+ * @param address The 8-byte address of the device.
  */
 void printSensorType(uint8_t address[8]);
 /**
@@ -52,6 +84,10 @@ void printSensorType(uint8_t address[8]);
  * @param address The 8-byte address of the sensor.
  */
 void sendTemperatureRequest(uint8_t address[8]);
+/**
+ * @brief Start a conversion on every device on the bus that has one (Skip ROM, Convert T).
+ */
+void sendBroadcastConversion();
 /**
  * @brief Read temperature data from the DS18x20 sensor.
  * @param address The 8-byte address of the sensor.
@@ -59,12 +95,51 @@ void sendTemperatureRequest(uint8_t address[8]);
  * @return True if the data is successfully read, false otherwise.
  */
 bool readTemperatureData(uint8_t address[8], uint8_t data[9]);
+/**
+ * @brief Read only the temperature bytes of the scratchpad, then abort the transfer.
+ * @param address The 8-byte address of the sensor.
+ * @param data The array to store the temperature data, only bytes 0 and 1 are written.
+ */
+void readTemperatureDataFast(uint8_t address[8], uint8_t data[9]);
+/**
+ * @brief Check a fast read, which has no CRC, against the last accepted reading.
+ * @param slot The sensor's slot.
+ * @param address The 8-byte address of the sensor.
+ * @param data The temperature data.
+ * @return True if the reading is believable.
+ */
+bool fastReadPlausible(int8_t slot, uint8_t address[8], uint8_t data[9]);
+/**
+ * @brief Read a sensor, fast when possible and with a full CRC-checked read otherwise.
+ * @param slot The sensor's slot.
+ * @param address The 8-byte address of the sensor.
+ * @param data The array to store the temperature data.
+ * @return True if the data is successfully read, false otherwise.
+ */
+bool readSensor(int8_t slot, uint8_t address[8], uint8_t data[9]);
+/**
+ * @brief DS18x20 driver read, see FamilyDrivers.c.
+ * @param slot The sensor's slot.
+ * @param rom The 8-byte address of the sensor.
+ * @param value Receives the temperature in Q4 format.
+ * @param conversionMs Receives the conversion time at the sensor's resolution.
+ * @return True if the data is successfully read, false otherwise.
+ */
+bool ds18x20Read(int8_t slot, uint8_t rom[8], int16_t *value, uint16_t *conversionMs);
 /**
  * @brief Validate the CRC of the temperature data.
  * @param data The temperature data.
  * @return True if the CRC is valid, false otherwise.
  */
 bool validateDataCRC(uint8_t data[9]);
+/**
+ * @brief Convert raw temperature data to a Q4 fixed point value (1/16 C per count)
+ * @param address The sensor address, used to calculate the type ( address[0] == 0x10 for DS18S20, otherwise DS18B20/DS1822).
+ * @param data The temperature data.
+ * @return The temperature in Q4 format.
+ */
+int16_t convertRawDataToQ4(uint8_t address[8], uint8_t data[9]);
+#if ONEWIRE_OUTPUT_FORMAT == ONEWIRE_OUTPUT_FLOAT
 /**
  * @brief Convert raw temperature data to Celsius
  * @param data The temperature data.
@@ -72,23 +147,59 @@ bool validateDataCRC(uint8_t data[9]);
  * @return The temperature in raw format.
  */
 float convertRawDataToCelsius(uint8_t address[8], uint8_t data[9]);
+#endif
+/**
+ * @brief Conversion time of the sensor at its configured resolution.
+ * @param address The sensor address, used to calculate the type.
+ * @param data The temperature data, holding the configuration register.
+ * @return The conversion time in milliseconds.
+ */
+uint16_t conversionTimeMs(uint8_t address[8], uint8_t data[9]);
 /**
  * @brief Print the temperature data.
  * @param address The 8-byte address of the sensor.
  * @param raw The raw temperature data.
  */
-void printTemperatureData(uint8_t address[8], float celsius);
+void printTemperatureData(uint8_t address[8], int16_t raw);
+/**
+ * @brief Print the value of a device that does not measure temperature.
+ * @param address The 8-byte address of the device.
+ * @param value The value read by its driver.
+ */
+void printDeviceValue(uint8_t address[8], int16_t value);
+/**
+ * @brief Store a reading in the sensor history and publish it in the register map.
+ * @param address The 8-byte address of the sensor.
+ * @param raw The temperature in Q4 format, or the device value.
+ * @param temperature True if 'raw' is a temperature; other values skip the history.
+ */
+void publishReading(uint8_t address[8], int16_t raw, bool temperature);
+/**
+ * @brief Milliseconds since startup.
+ * @return The time in milliseconds, used to timestamp readings.
+ */
+uint32_t millis();
+/**
+ * @brief Move the millisecond clock on by time SysTick did not see, e.g. spent in standby.
+ * @param ms The milliseconds to add.
+ */
+void millisAdvance(uint32_t ms);
 
 /**
  * @brief Initializes the hardware
  * This function initializes the hardware for temperature sensor communication on pin C4
  */
 void setup() {
-    GPIO_port_enable(GPIO_port_C);
-    GPIO_pinMode(GPIOv_from_PORT_PIN(GPIO_port_C, 4), GPIO_pinMode_O_pushPull, GPIO_Speed_50MHz);
+    RegMapBegin();
+    RegMapI2CBegin();
+    OneWireBegin(); // Enables the clock of the bus pin's port.
+    CouplerBegin();
+    LowPowerBegin();
+
+    LogBegin();
 
-    printf("Starting up..\n\n");
-    printf("Looking for temperature sensors..\n");
+    LogPuts("Starting up..\n\n");
+    LogPuts("Looking for temperature sensors..\n");
 }
 
 /**
@@ -96,69 +207,215 @@ void setup() {
  * This function is the main loop that performs temperature measurements using DS18B20 sensors.
  */
 
-uint32_t startTime = 0;
 int state = FIND_SENSOR;
+int8_t slot;
 uint8_t address[8];
 uint8_t data[9];
-float temperatureInC;
+const FamilyDriver *driver;                   // Driver of the device being serviced
+int16_t temperatureQ4;                        // Its reading, a Q4 temperature or the driver's value
+uint16_t conversionMs;
+uint8_t sensorsFound = 0; // Sensors added in the current discovery pass
+uint32_t lastDiscovery = 0;
+bool enumerating = false;     // A discovery pass is in progress
+uint32_t enumerationStartMs;
+uint32_t enumerationRetries;  // Search counters at the start of the pass
+uint32_t enumerationFailures;
+uint32_t enumerationCutShort;
+uint8_t sensorConfig[SENSOR_HISTORY_SLOTS];   // Configuration register from the last full read, 0 if unknown
+uint8_t fastReadsLeft[SENSOR_HISTORY_SLOTS];  // Fast reads allowed before the next full read
+uint32_t fastReadFallbacks = 0;               // Fast reads that failed the plausibility checks
 
 int loop() {
 
     switch (state) {
         case FIND_SENSOR:
+            if (!enumerating) {
+                enumerating = true;
+                enumerationStartMs = millis();
+#if ONEWIRE_SEARCH
+                enumerationRetries = OneWireSearchRetries;
+                enumerationFailures = OneWireSearchFailures;
+                enumerationCutShort = OneWireSearchCutShort;
+#endif
+            }
             if (!findNextSensor(address)) {
-                printf("----\nLooking for temperature sensors..\n");
-                Delay_Ms(250); // Not strictly needed, but slows down search loop when no sensors are found.
-                OneWireResetSearch();
-                state = FIND_SENSOR;
+                if (CouplerSearchNextBranch()) {
+                    resetSensorSearch(); // Enumerate the next coupler branch.
+                    break;
+                }
+                enumerating = false;
+#if ONEWIRE_SEARCH
+                if (sensorsFound || OneWireSearchRetries != enumerationRetries) {
+                    LogPuts("Enumeration: ");
+                    LogPutU32(sensorsFound);
+                    LogPuts(" new devices in ");
+                    LogPutU32(millis() - enumerationStartMs);
+                    LogPuts("ms, ");
+                    LogPutU32(OneWireSearchRetries - enumerationRetries);
+                    LogPuts(" retries, ");
+                    LogPutU32(OneWireSearchFailures - enumerationFailures);
+                    LogPuts(" skipped (");
+                    LogPutU32(OneWireSearchCutShort - enumerationCutShort);
+                    LogPuts(" cut short)\n");
+#if ONEWIRE_FAST_READ || ONEWIRE_COUPLER
+                    LogPuts("Since start");
+#if ONEWIRE_FAST_READ
+                    LogPuts(", ");
+                    LogPutU32(fastReadFallbacks);
+                    LogPuts(" fast read fallbacks");
+#endif
+#if ONEWIRE_COUPLER
+                    LogPuts(", ");
+                    LogPutU32(couplerSwitches);
+                    LogPuts(" branch switches");
+#endif
+                    LogPuts("\n");
+#endif
+                }
+#endif
+                RegMapSetFlags(REGMAP_FLAG_NO_SENSORS, SchedulerCount() == 0);
+                sensorsFound = 0;
+                resetSensorSearch();
+                lastDiscovery = millis();
+                if (SchedulerCount() == 0) {
+                    LogPuts("----\nLooking for temperature sensors..\n");
+#if ONEWIRE_HOTPLUG
+                    state = SCHEDULE_NEXT; // Idle until a presence pulse shows up.
+#else
+                    Delay_Ms(250); // Not strictly needed, but slows down search loop when no sensors are found.
+                    state = FIND_SENSOR;
+#endif
+                } else {
+                    state = SCHEDULE_NEXT;
+                }
             } else {
                 state = VALIDATE_ADDRESS;
             }
             break;
         case VALIDATE_ADDRESS:
             if (!validateAddressCRC(address)) {
-                printf("Sensor found, but it responded with an invalid address. Skipping.\n");
-                state = FIND_SENSOR;
+                LogPuts("Sensor found, but it responded with an invalid address. Skipping.\n");
+            } else if (ONEWIRE_COUPLER && address[0] == COUPLER_FAMILY) {
+                if (CouplerAdd(address)) {
+                    LogPuts("DS2409 coupler found, its branches are searched next.\n");
+                }
+            } else if (FamilyDriverFind(address[0]) == NULL) {
+                printSensorType(address); // Reports the unsupported family.
             } else {
-                state = REQUEST_TEMPERATURE;
+                bool known = SensorHistoryFind(address) >= 0;
+                int8_t added = SchedulerAdd(address, millis());
+                if (!known && added >= 0) {
+                    // Counted here only: trunk sensors show up again in every branch pass.
+                    sensorsFound++;
+                    // The slot may have belonged to a dropped sensor.
+                    sensorConfig[added] = 0;
+                    fastReadsLeft[added] = 0;
+                    RegMapClear(added);
+                    CouplerAssign(added); // Remember which branch it was found on.
+                }
             }
+            state = FIND_SENSOR;
             break;
-        case REQUEST_TEMPERATURE:
-            sendTemperatureRequest(address);
-            state = WAIT_FOR_SENSOR_READ;
+        case SCHEDULE_NEXT:
+            // Conversions run in the background; only service the
+            // sensor the scheduler says is due, otherwise stay idle.
+            if (OneWireHotplugPending()) {
+                LogPuts("Presence pulse on the idle bus, searching..\n");
+                CouplerSelect(COUPLER_TRUNK); // A discovery pass starts on the trunk.
+                state = FIND_SENSOR;
+                break;
+            }
+            if (millis() - lastDiscovery >= DISCOVERY_PERIOD_MS) {
+                CouplerSelect(COUPLER_TRUNK);
+                state = FIND_SENSOR;
+                break;
+            }
+            switch (SchedulerNext(millis(), &slot)) {
+                case SCHED_ACTION_CONVERT:
+                    memcpy(address, sensorHistory[slot].rom, 8);
+                    CouplerSelect(CouplerBranchOf(slot)); // A failed switch shows up as a failed read.
+                    state = REQUEST_TEMPERATURE;
+                    break;
+                case SCHED_ACTION_READ:
+                    memcpy(address, sensorHistory[slot].rom, 8);
+                    CouplerSelect(CouplerBranchOf(slot));
+                    state = READ_TEMPERATURE_DATA;
+                    break;
+                case SCHED_ACTION_CONVERT_ALL:
+                    CouplerSelect(CouplerBranchOf(slot)); // The broadcast covers the due sensor's branch.
+                    state = REQUEST_ALL_TEMPERATURES;
+                    break;
+                default:
+                    OneWireHotplugArm(); // Nothing to do, watch the bus for new devices.
+#if ONEWIRE_LOWPOWER
+                    if (LogIdle()) {
+                        millisAdvance(LowPowerSleep(SchedulerIdleMs(millis())));
+                    }
+#endif
+                    state = SCHEDULE_NEXT;
+                    break;
+            }
             break;
-        case WAIT_FOR_SENSOR_READ:
-            // Delay for roughly one second between 
-            // asking for temperature and later reading it.
-            if(startTime >= TEMP_READ_DELAY) {
-                state = READ_TEMPERATURE_DATA;
-                startTime = 0;
-            } else {
-                startTime++;
-                state = WAIT_FOR_SENSOR_READ;
+        case REQUEST_TEMPERATURE:
+            driver = FamilyDriverFind(address[0]);
+            if (driver->convert) {
+                uint32_t start = SysTick->CNT;
+                driver->convert(address);
+                PlanObserveConvert(address, SysTick->CNT - start);
             }
+            SchedulerConverting(slot, millis());
+            state = SCHEDULE_NEXT;
+            break;
+#if ONEWIRE_LOWPOWER
+        case REQUEST_ALL_TEMPERATURES:
+            sendBroadcastConversion();
+            LowPowerSweep(millis(), SchedulerConvertingAll(millis()), schedEntries[slot].conversionMs);
+            state = SCHEDULE_NEXT;
             break;
+#endif
         case READ_TEMPERATURE_DATA:
             // The temp sensors use a slow data rate. The read 
             // can take a few hundred milliseconds, so it will 
             // disrupt time critical stuff like multiplexing a display.
-            if (!readTemperatureData(address, data)) {
-                printf("Failed to recieve temperature data.\n");
-                state = FIND_SENSOR;
+            driver = FamilyDriverFind(address[0]);
+            if (!driver->read(slot, address, &temperatureQ4, &conversionMs)) {
+                LogPuts("Failed to recieve temperature data.\n");
+#if ONEWIRE_READ_MULTISAMPLE
+                LogPuts("Read slots sample at ");
+                LogPutU32(OneWireReadSamplePoint());
+                LogPuts("us, samples disagreed in ");
+                LogPutU32(oneWireReadDisagreements);
+                LogPuts(" slots.\n");
+#endif
+#if ONEWIRE_TRACE
+                OneWireTraceDump(); // Show what the bus did below the failed read.
+#endif
+                RegMapUpdate(slot, address, false, false, 0, millis());
+                SchedulerReadDone(slot, false, 0, 0, millis());
+                state = SCHEDULE_NEXT;
             } else {
-                temperatureInC = convertRawDataToCelsius(address, data);
+                publishReading(address, temperatureQ4, driver->flags & DRIVER_TEMPERATURE);
+                SchedulerReadDone(slot, true, temperatureQ4, conversionMs, millis());
                 state = PRINT_TEMPERATURE_DATA;
             }
             break;
         case PRINT_TEMPERATURE_DATA:
             printSensorType(address);
-            printTemperatureData(address, temperatureInC);
-            state = FIND_SENSOR;
+            if (driver->flags & DRIVER_TEMPERATURE) {
+                printTemperatureData(address, temperatureQ4);
+            } else {
+                printDeviceValue(address, temperatureQ4);
+            }
+            state = SCHEDULE_NEXT;
             break;
     }
 
     // More features, background tasks, etc can be added here.
 
+    RegMapService(millis()); // Keep reading ages current for the host.
+    LogService(); // Hand buffered log output to the UART DMA, never blocks.
+    millis(); // Keep the millisecond clock ahead of SysTick wrap-around.
+
     return 0;
 }
 
@@ -181,15 +438,63 @@ int main() {
  * @brief Find the next DS18x20 sensor on the one-wire bus.
  * @param address The 8-byte address of the found sensor.
  * @return True if a sensor is found, false otherwise.
- * This function searches for the next DS18x20 sensor on the one-wire bus.
+ * This function searches for the next device on the one-wire bus. With the family drivers
+ * built in, the pass runs one targeted search per supported family, so devices without a
+ * driver are never enumerated.
  */
+#if !ONEWIRE_SEARCH
+static const uint8_t fixedRoms[][8] = { ONEWIRE_FIXED_ROMS };
+uint8_t fixedRomIndex = 0;
+#elif ONEWIRE_FAMILIES
+uint8_t searchFamilyIndex = 0;    // FamilySearchCode() index being searched
+bool searchFamilyStarted = false;
+#endif
+
 bool findNextSensor(uint8_t address[8]) {
+#if ONEWIRE_SEARCH && ONEWIRE_FAMILIES
+    uint8_t family;
+    while ((family = FamilySearchCode(searchFamilyIndex)) != 0) {
+        if (!searchFamilyStarted) {
+            OneWireTargetSearch(family);
+            searchFamilyStarted = true;
+        }
+        // The search runs on past the family, stop at its first other device.
+        if (OneWireSearch(address, true) && address[0] == family) {
+            return true;
+        }
+        searchFamilyIndex++;
+        searchFamilyStarted = false;
+    }
+    return false;
+#elif ONEWIRE_SEARCH
     if (!OneWireSearch(address, true)) {
         return false;
     }
+#else
+    // Built without the search engine, walk the configured ROM list instead.
+    if (fixedRomIndex >= sizeof(fixedRoms) / sizeof(fixedRoms[0])) {
+        return false;
+    }
+    memcpy(address, fixedRoms[fixedRomIndex++], 8);
+#endif
     return true;
 }
 
+/**
+ * @brief Start the next findNextSensor() pass from the first sensor again.
+ */
+void resetSensorSearch() {
+#if ONEWIRE_SEARCH
+    OneWireResetSearch();
+#if ONEWIRE_FAMILIES
+    searchFamilyIndex = 0;
+    searchFamilyStarted = false;
+#endif
+#else
+    fixedRomIndex = 0;
+#endif
+}
+
 /**
  * @brief Validate the CRC of the sensor's address.
  * @param address The 8-byte address of the sensor.
@@ -209,19 +514,14 @@ bool validateAddressCRC(uint8_t address[8]) {
  * This function prints the type of DS18x20 sensor based on its address.
  */
 void printSensorType(uint8_t address[8]) {
-    switch (address[0]) {
-        case 0x10:
-            printf("DS18S20 ");  // or old DS1820
-            break;
-        case 0x28:
-            printf("DS18B20 ");
-            break;
-        case 0x22:
-            printf("DS1822 ");
-            break;
-        default:
-            printf("Device is not a DS18x20 family device.\n");
-            break;
+    const FamilyDriver *d = FamilyDriverFind(address[0]);
+    if (d) {
+        LogPuts(d->name);
+        LogPutc(' ');
+    } else {
+        LogPuts("No driver for device family 0x");
+        LogPutHex8(address[0]);
+        LogPuts(", skipping.\n");
     }
 }
 
@@ -236,6 +536,16 @@ void sendTemperatureRequest(uint8_t address[8]) {
     OneWireWrite(0x44, 0);  // start conversion, with no parasite power on at the end
 }
 
+/**
+ * @brief Start a conversion on every device on the bus that has one (Skip ROM, Convert T).
+ * DS18x20 and DS2438 both convert on 0x44, the other supported families ignore it.
+ */
+void sendBroadcastConversion() {
+    OneWireReset();
+    OneWireSkip();
+    OneWireWrite(0x44, 0);
+}
+
 /**
  * @brief Read temperature data from the DS18x20 sensor.
  * @param address The 8-byte address of the sensor.
@@ -257,13 +567,98 @@ bool readTemperatureData(uint8_t address[8], uint8_t data[9]) {
 }
 
 /**
- * @brief Convert raw temperature data to Celsius
+ * @brief Read only the temperature bytes of the scratchpad, then abort the transfer.
+ * @param address The 8-byte address of the sensor.
+ * @param data The array to store the temperature data, only bytes 0 and 1 are written.
+ * This function clocks in 2 of the 9 scratchpad bytes and resets the bus to end the read.
+ */
+void readTemperatureDataFast(uint8_t address[8], uint8_t data[9]) {
+    OneWireReset();
+    OneWireSelect(address);
+    OneWireWrite(0xBE, 0);  // Read Scratchpad
+    data[0] = OneWireRead();
+    data[1] = OneWireRead();
+    OneWireReset();         // Abort, the sensor stops sending on reset
+}
+
+/**
+ * @brief Check a fast read, which has no CRC, against the last accepted reading.
+ * @param slot The sensor's slot.
+ * @param address The 8-byte address of the sensor.
  * @param data The temperature data.
+ * @return True if the reading is believable.
+ * This function rejects the 85 C power-on value, the stuck-bus patterns 0xFFFF and 0x0000
+ * and changes faster than FAST_READ_MAX_RATE_Q4 per second since the last reading.
+ */
+bool fastReadPlausible(int8_t slot, uint8_t address[8], uint8_t data[9]) {
+    uint16_t word = (data[1] << 8) | data[0];
+    if (word == 0x0550 || word == 0xFFFF || word == 0x0000) {
+        return false;
+    }
+    SensorSample last;
+    if (!SensorHistoryLatest(slot, &last)) {
+        return false;
+    }
+    uint32_t seconds = (millis() - last.timeMs) / 1000 + 1;
+    int32_t bound = FAST_READ_MAX_RATE_Q4 * seconds + FAST_READ_MARGIN_Q4;
+    int32_t change = convertRawDataToQ4(address, data) - last.raw;
+    return change <= bound && change >= -bound;
+}
+
+/**
+ * @brief Read a sensor, fast when possible and with a full CRC-checked read otherwise.
+ * @param slot The sensor's slot.
+ * @param address The 8-byte address of the sensor.
+ * @param data The array to store the temperature data.
+ * @return True if the data is successfully read, false otherwise.
+ * The DS18S20 needs the count remain bytes for its extended resolution, so it is always read in full.
+ */
+bool readSensor(int8_t slot, uint8_t address[8], uint8_t data[9]) {
+    if (ONEWIRE_FAST_READ && address[0] != 0x10 && sensorConfig[slot] && fastReadsLeft[slot]) {
+        readTemperatureDataFast(address, data);
+        data[4] = sensorConfig[slot];
+        if (fastReadPlausible(slot, address, data)) {
+            fastReadsLeft[slot]--;
+            return true;
+        }
+        fastReadFallbacks++;
+    }
+    uint8_t retries = SCRATCHPAD_READ_RETRIES;
+    while (!readTemperatureData(address, data)) {
+        if (retries-- == 0) {
+            return false;
+        }
+    }
+    sensorConfig[slot] = data[4];
+    fastReadsLeft[slot] = FAST_READ_FULL_EVERY;
+    return true;
+}
+
+/**
+ * @brief DS18x20 driver read, see FamilyDrivers.c.
+ * @param slot The sensor's slot.
+ * @param rom The 8-byte address of the sensor.
+ * @param value Receives the temperature in Q4 format.
+ * @param conversionMs Receives the conversion time at the sensor's resolution.
+ * @return True if the data is successfully read, false otherwise.
+ */
+bool ds18x20Read(int8_t slot, uint8_t rom[8], int16_t *value, uint16_t *conversionMs) {
+    if (!readSensor(slot, rom, data)) {
+        return false;
+    }
+    *value = convertRawDataToQ4(rom, data);
+    *conversionMs = conversionTimeMs(rom, data);
+    return true;
+}
+
+/**
+ * @brief Convert raw temperature data to a Q4 fixed point value (1/16 C per count)
  * @param address The sensor address, used to calculate the type ( address[0] == 0x10 for DS18S20, otherwise DS18B20/DS1822).
- * @return The temperature in celsius.
- * This function converts the sensors temperature data to Celsius based on the sensor type.
+ * @param data The temperature data.
+ * @return The temperature in Q4 format.
+ * This function normalizes the sensors temperature data to 1/16 C per count based on the sensor type.
  */
-float convertRawDataToCelsius(uint8_t address[8], uint8_t data[9]) {
+int16_t convertRawDataToQ4(uint8_t address[8], uint8_t data[9]) {
     int16_t raw = (data[1] << 8) | data[0];
     if (address[0] == 0x10 ) {
         raw = raw << 3;  // 9 bit resolution default
@@ -277,7 +672,35 @@ float convertRawDataToCelsius(uint8_t address[8], uint8_t data[9]) {
         else if (cfg == 0x40) raw = raw & ~1;  // 11 bit res, 375 ms
         // default is 12 bit resolution, 750 ms conversion time
     }
-    return (float)(raw / 16.0);
+    return raw;
+}
+
+#if ONEWIRE_OUTPUT_FORMAT == ONEWIRE_OUTPUT_FLOAT
+/**
+ * @brief Convert raw temperature data to Celsius
+ * @param data The temperature data.
+ * @param address The sensor address, used to calculate the type ( address[0] == 0x10 for DS18S20, otherwise DS18B20/DS1822).
+ * @return The temperature in celsius.
+ * This function converts the sensors temperature data to Celsius based on the sensor type.
+ */
+float convertRawDataToCelsius(uint8_t address[8], uint8_t data[9]) {
+    return (float)(convertRawDataToQ4(address, data) / 16.0);
+}
+#endif
+
+/**
+ * @brief Conversion time of the sensor at its configured resolution.
+ * @param address The sensor address, used to calculate the type.
+ * @param data The temperature data, holding the configuration register.
+ * @return The conversion time in milliseconds.
+ * This function lets the scheduler read a sensor as soon as its conversion is done.
+ */
+uint16_t conversionTimeMs(uint8_t address[8], uint8_t data[9]) {
+    if (address[0] == 0x10) {
+        return 750; // DS18S20 always converts at full resolution
+    }
+    // 93.75 ms at 9 bit, doubling per extra bit, rounded up.
+    return 94 << ((data[4] >> 5) & 3);
 }
 
 /**
@@ -286,16 +709,87 @@ float convertRawDataToCelsius(uint8_t address[8], uint8_t data[9]) {
  * @param raw The raw temperature data.
  * This function prints the temperature data in Celsius and Fahrenheit.
  */
-void printTemperatureData(uint8_t address[8], float celsius) {
+void printTemperatureData(uint8_t address[8], int16_t raw) {
 
+    LogPuts("0x");
+    for (uint8_t i = 0; i < 8; i++) {
+        LogPutHex8(address[i]);
+    }
+    LogPuts(": ");
+#if ONEWIRE_OUTPUT_FORMAT == ONEWIRE_OUTPUT_FLOAT
+    float celsius = (float)(raw / 16.0);
     float fahrenheit = (celsius * 1.8 + 32.0);
-    
-    printf("0x");
+
+    LogPutI32((int)celsius);
+    LogPuts("C, ");
+    LogPutI32((int)fahrenheit);
+#else
+    int16_t fahrenheit = (int32_t)raw * 9 / 5 + (32 << 4);
+
+    LogPutQ4(raw);
+    LogPuts("C, ");
+    LogPutQ4(fahrenheit);
+#endif
+    LogPuts("F\n");
+}
+
+/**
+ * @brief Print the value of a device that does not measure temperature.
+ * @param address The 8-byte address of the device.
+ * @param value The value read by its driver.
+ * This function prints the value in hex, its meaning depends on the family (see FamilyDrivers.c).
+ */
+void printDeviceValue(uint8_t address[8], int16_t value) {
+    LogPuts("0x");
     for (uint8_t i = 0; i < 8; i++) {
-        printf("%02X", address[i]);
+        LogPutHex8(address[i]);
     }
-    printf(": %d", (int)celsius);
-    printf("C, ");
-    printf("%d", (int)fahrenheit);
-    printf("F\n");
+    LogPuts(": 0x");
+    LogPutHex8((uint16_t)value >> 8);
+    LogPutHex8(value & 0xFF);
+    LogPutc('\n');
+}
+
+
+/**
+ * @brief Store a reading in the sensor history and publish it in the register map.
+ * @param address The 8-byte address of the sensor.
+ * @param raw The temperature in Q4 format, or the device value.
+ * @param temperature True if 'raw' is a temperature; other values skip the history and its filter.
+ * This function records the reading so both local consumers and the external host see it.
+ */
+void publishReading(uint8_t address[8], int16_t raw, bool temperature) {
+    uint32_t now = millis();
+    bool accepted = !temperature || SensorHistoryAdd(address, raw, now);
+    RegMapUpdate(SensorHistoryFind(address), address, true, !accepted, raw, now);
+}
+
+/**
+ * @brief Milliseconds since startup.
+ * @return The time in milliseconds.
+ * This function extends the 32-bit SysTick counter into a millisecond clock. It must be
+ * called at least once per SysTick wrap-around (several minutes), which the main loop does.
+ */
+uint32_t millisLastCount = 0;
+uint32_t millisRemainder = 0;
+uint32_t millisNow = 0;
+
+uint32_t millis() {
+    uint32_t count = SysTick->CNT;
+    millisRemainder += count - millisLastCount;
+    millisLastCount = count;
+    millisNow += millisRemainder / DELAY_MS_TIME;
+    millisRemainder %= DELAY_MS_TIME;
+    return millisNow;
+}
+
+/**
+ * @brief Move the millisecond clock on by time SysTick did not see, e.g. spent in standby.
+ * @param ms The milliseconds to add.
+ * SysTick restarts when the clocks come back, so counting resumes from its current value.
+ */
+void millisAdvance(uint32_t ms) {
+    millis();
+    millisNow += ms;
+    millisLastCount = SysTick->CNT;
 }
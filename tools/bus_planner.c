@@ -0,0 +1,158 @@
+/**
+ * @file bus_planner.c
+ * @brief Host tool: bus budget and sample rate of a sweep, from BusPlanner.c
+ * @license MIT License
+ * @details Build with `make tools/bus_planner`, then e.g.
+ *
+ *   tools/bus_planner -n 12 -r 12 -t 1000          12 DS18B20s at 12 bits, one sample a second?
+ *   tools/bus_planner -P -r 10 28FF4A1D93160352    this sensor at 10 bits on parasite power
+ *
+ * Sensors are given as 16 hex digit ROM codes, family code first as the firmware prints
+ * them, or as a count of made-up DS18B20 addresses with -n. Prints the bus time of every
+ * transaction, the sweep and, with a period, how many sensors fit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ONEWIRE_PLANNER 0
+#include "../BusPlanner.c"
+
+#define MAX_DEVICES 256
+
+static PlanDevice devices[MAX_DEVICES];
+
+static void usage(const char *name) {
+    fprintf(stderr,
+        "usage: %s [-r bits] [-t period_ms] [-s slots] [-P] [-B] [-S] [-F] (-n count | rom...)\n"
+        "  -r bits       resolution, 9..12 (default 12)\n"
+        "  -t period_ms  requested sample period, flags sweeps that do not fit\n"
+        "  -s slots      sensor slots in the firmware, flags tables that do not fit\n"
+        "  -P            parasite power, one conversion at a time\n"
+        "  -B            broadcast conversions (ONEWIRE_LOWPOWER)\n"
+        "  -S            sequential conversions (ONEWIRE_ASYNC=0)\n"
+        "  -F            full nine byte reads, no fast reads\n"
+        "  -n count      plan for count made-up DS18B20 addresses\n", name);
+    exit(2);
+}
+
+static bool parseRom(const char *text, uint8_t rom[8]) {
+    if (strlen(text) != 16) {
+        return false;
+    }
+    for (int i = 0; i < 8; i++) {
+        unsigned int b;
+        if (sscanf(text + 2 * i, "%2x", &b) != 1) {
+            return false;
+        }
+        rom[i] = b;
+    }
+    return true;
+}
+
+// A plausible DS18B20 address with a valid CRC, so the bit pattern is realistic.
+static void makeRom(uint16_t index, uint8_t rom[8]) {
+    uint32_t x = 0x9E3779B9u * (index + 1);
+    rom[0] = 0x28;
+    for (int i = 1; i < 7; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        rom[i] = x;
+    }
+    uint8_t crc = 0;
+    for (int i = 0; i < 7; i++) {
+        uint8_t b = rom[i];
+        for (int j = 0; j < 8; j++) {
+            uint8_t mix = (crc ^ b) & 0x01;
+            crc >>= 1;
+            if (mix) crc ^= 0x8C;
+            b >>= 1;
+        }
+    }
+    rom[7] = crc;
+}
+
+int main(int argc, char **argv) {
+    PlanConfig cfg = { PLAN_POWER_EXTERNAL, PLAN_CONVERT_EACH, true, true, 0, 0 };
+    int resolution = 12;
+    int count = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:t:s:PBSFn:")) != -1) {
+        switch (opt) {
+            case 'r': resolution = atoi(optarg); break;
+            case 't': cfg.periodMs = strtoul(optarg, NULL, 0); break;
+            case 's': cfg.maxSensors = atoi(optarg); break;
+            case 'P': cfg.power = PLAN_POWER_PARASITE; break;
+            case 'B': cfg.convert = PLAN_CONVERT_BROADCAST; break;
+            case 'S': cfg.overlap = false; break;
+            case 'F': cfg.fastRead = false; break;
+            case 'n': count = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (resolution < 9 || resolution > 12 || count < 0 || count > MAX_DEVICES
+            || (count == 0) == (optind == argc) || argc - optind > MAX_DEVICES) {
+        usage(argv[0]);
+    }
+
+    uint16_t n = count ? count : argc - optind;
+    for (uint16_t i = 0; i < n; i++) {
+        if (count) {
+            makeRom(i, devices[i].rom);
+        } else if (!parseRom(argv[optind + i], devices[i].rom)) {
+            fprintf(stderr, "bad ROM code: %s\n", argv[optind + i]);
+            return 2;
+        }
+        devices[i].resolution = resolution;
+    }
+
+    printf("Reset          %6u us\n", (unsigned)PlanResetUs());
+    printf("Write 0 / 1    %6u / %u us per slot\n", PLAN_WRITE0_US, PLAN_WRITE1_US);
+    printf("Read           %6u us per slot\n", PLAN_READ_US);
+    if (cfg.convert == PLAN_CONVERT_BROADCAST) {
+        printf("Broadcast      %6u us\n", (unsigned)PlanBroadcastUs());
+    }
+    for (uint16_t i = 0; i < n && i < 8; i++) {
+        printf("%02X%02X%02X%02X%02X%02X%02X%02X  convert %u us, read %u us, converts %u ms\n",
+            devices[i].rom[0], devices[i].rom[1], devices[i].rom[2], devices[i].rom[3],
+            devices[i].rom[4], devices[i].rom[5], devices[i].rom[6], devices[i].rom[7],
+            (unsigned)PlanConvertUs(devices[i].rom),
+            (unsigned)PlanScratchpadUs(devices[i].rom, cfg.fastRead),
+            (unsigned)PlanConversionMs(&devices[i]));
+    }
+    if (n > 8) {
+        printf("... %u more\n", n - 8);
+    }
+
+    PlanResult result;
+    PlanSweep(devices, n, &cfg, &result);
+    printf("\n%u sensors: bus busy %u.%03u ms per sweep, sweep %u.%03u ms, %u.%03u samples/s per sensor\n",
+        n, (unsigned)(result.busUs / 1000), (unsigned)(result.busUs % 1000),
+        (unsigned)(result.sweepUs / 1000), (unsigned)(result.sweepUs % 1000),
+        (unsigned)(result.rateMilliHz / 1000), (unsigned)(result.rateMilliHz % 1000));
+
+    if (cfg.periodMs) {
+        // The largest table with the same addressing pattern that still fits the period.
+        uint16_t fits = 0;
+        PlanResult r;
+        for (uint16_t m = 1; m <= MAX_DEVICES; m++) {
+            if (m > n) {
+                makeRom(m - 1, devices[m - 1].rom);
+                devices[m - 1].resolution = resolution;
+            }
+            PlanSweep(devices, m, &cfg, &r);
+            if (r.flags & (PLAN_FLAG_TOO_SLOW | PLAN_FLAG_BUS_OVERLOAD)) {
+                break;
+            }
+            fits = m;
+        }
+        printf("At most %u sensors for one sample every %u ms\n", fits, (unsigned)cfg.periodMs);
+    }
+
+    if (result.flags & PLAN_FLAG_TOO_SLOW) printf("NOT FEASIBLE: a sweep takes longer than the period\n");
+    if (result.flags & PLAN_FLAG_BUS_OVERLOAD) printf("NOT FEASIBLE: the bus alone is busy longer than the period\n");
+    if (result.flags & PLAN_FLAG_TOO_MANY) printf("NOT FEASIBLE: more sensors than firmware slots\n");
+    return result.flags ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file regmap_test.c
+ * @brief Host test of the register map in RegisterMap.c
+ * @license MIT License
+ * @details Build and run with `make regmap-test`. Drives RegisterMap.c through the same
+ * calls the firmware and the I2C transport make, with the interrupt lock stubbed out, and
+ * checks the layout a host controller relies on: header, block offsets, little-endian
+ * values, status bits, clearing a slot and the auto-incrementing register pointer.
+ *
+ * Prints every failed check and exits with 1 if there was one.
+ */
+
+#include <stdio.h>
+
+#define ONEWIRE_REGMAP 1
+#define REGMAP_SENSORS 4
+
+static int lockDepth;                    // Must be back to 0 after every call
+static int lockErrors;                   // Nested or unbalanced lock use
+
+#define REGMAP_LOCK()   do { if (lockDepth++) lockErrors++; } while (0)
+#define REGMAP_UNLOCK() do { if (--lockDepth) lockErrors++; } while (0)
+
+#include "../RegisterMap.c"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: FAILED %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static const uint8_t rom0[8] = { 0x28, 0xFF, 0x4A, 0x1D, 0x93, 0x16, 0x03, 0x52 };
+static const uint8_t rom1[8] = { 0x26, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77 };
+
+static uint8_t block(uint8_t slot, uint8_t offset) {
+    return regMap[REGMAP_ADDR_BLOCKS + slot * REGMAP_BLOCK_SIZE + offset];
+}
+
+static uint16_t block16(uint8_t slot, uint8_t offset) {
+    return block(slot, offset) | (block(slot, offset + 1) << 8);
+}
+
+static uint16_t sequence() {
+    return regMap[REGMAP_ADDR_SEQUENCE] | (regMap[REGMAP_ADDR_SEQUENCE + 1] << 8);
+}
+
+static void testLayout() {
+    CHECK(REGMAP_ADDR_BLOCKS == 0x08);
+    CHECK(REGMAP_BLOCK_SIZE == 16);
+    CHECK(REGMAP_BLOCK_ROM == 0 && REGMAP_BLOCK_RAW == 8 && REGMAP_BLOCK_AGE == 10);
+    CHECK(REGMAP_BLOCK_STATUS == 12 && REGMAP_BLOCK_ERRORS == 13 && REGMAP_BLOCK_SAMPLES == 14);
+    CHECK(REGMAP_SIZE == 0x08 + 4 * 16);
+    CHECK(sizeof(regMap) == REGMAP_SIZE);
+
+    RegMapBegin();
+    CHECK(regMap[REGMAP_ADDR_ID] == REGMAP_ID);
+    CHECK(regMap[REGMAP_ADDR_VERSION] == REGMAP_VERSION);
+    CHECK(regMap[REGMAP_ADDR_COUNT] == 0);
+    CHECK(regMap[REGMAP_ADDR_FLAGS] == 0);
+    CHECK(sequence() == 0);
+}
+
+static void testEncode() {
+    RegMapBegin();
+    RegMapSetFlags(REGMAP_FLAG_NO_SENSORS, true);
+    CHECK(regMap[REGMAP_ADDR_FLAGS] == REGMAP_FLAG_NO_SENSORS);
+
+    RegMapUpdate(1, rom0, true, false, -0x0123, 1000);
+    CHECK(memcmp(&regMap[REGMAP_ADDR_BLOCKS + REGMAP_BLOCK_SIZE], rom0, 8) == 0);
+    CHECK(block(1, REGMAP_BLOCK_RAW) == 0xDD && block(1, REGMAP_BLOCK_RAW + 1) == 0xFE);
+    CHECK(block16(1, REGMAP_BLOCK_AGE) == 0);
+    CHECK(block(1, REGMAP_BLOCK_STATUS) == REGMAP_STATUS_VALID);
+    CHECK(block(1, REGMAP_BLOCK_ERRORS) == 0);
+    CHECK(block16(1, REGMAP_BLOCK_SAMPLES) == 1);
+    CHECK(regMap[REGMAP_ADDR_COUNT] == 2);
+    CHECK(regMap[REGMAP_ADDR_FLAGS] == 0);
+    CHECK(sequence() == 1);
+    for (uint8_t i = 0; i < REGMAP_BLOCK_SIZE; i++) {
+        CHECK(block(0, i) == 0);         // A lower slot is untouched
+    }
+
+    // A failed read keeps the reading and counts the error.
+    RegMapUpdate(1, rom0, false, false, 0, 2000);
+    RegMapUpdate(1, rom0, false, false, 0, 3000);
+    CHECK(block16(1, REGMAP_BLOCK_RAW) == (uint16_t)-0x0123);
+    CHECK(block(1, REGMAP_BLOCK_STATUS) == (REGMAP_STATUS_VALID | REGMAP_STATUS_READ_ERROR));
+    CHECK(block(1, REGMAP_BLOCK_ERRORS) == 2);
+    CHECK(block16(1, REGMAP_BLOCK_SAMPLES) == 1);
+
+    // The age counts seconds since the last good reading.
+    RegMapService(5500);
+    CHECK(block16(1, REGMAP_BLOCK_AGE) == 4);
+
+    // Out of range slots are ignored.
+    uint16_t seq = sequence();
+    RegMapUpdate(-1, rom1, true, false, 1, 0);
+    RegMapUpdate(REGMAP_SENSORS, rom1, true, false, 1, 0);
+    CHECK(sequence() == seq);
+    CHECK(regMap[REGMAP_ADDR_COUNT] == 2);
+}
+
+static void testOutlier() {
+    RegMapBegin();
+    RegMapUpdate(0, rom0, true, false, 0x0190, 1000);
+    RegMapUpdate(0, rom0, false, false, 0, 2000);
+    RegMapService(3000);
+
+    // An outlier keeps RAW, AGE and SAMPLES, and ends the error streak.
+    RegMapUpdate(0, rom0, true, true, 0x7FF0, 3000);
+    CHECK(block16(0, REGMAP_BLOCK_RAW) == 0x0190);
+    CHECK(block16(0, REGMAP_BLOCK_AGE) == 2);
+    CHECK(block16(0, REGMAP_BLOCK_SAMPLES) == 1);
+    CHECK(block(0, REGMAP_BLOCK_ERRORS) == 0);
+    CHECK(block(0, REGMAP_BLOCK_STATUS) == (REGMAP_STATUS_VALID | REGMAP_STATUS_OUTLIER));
+
+    // The next accepted reading clears the flag.
+    RegMapUpdate(0, rom0, true, false, 0x0191, 4000);
+    CHECK(block16(0, REGMAP_BLOCK_RAW) == 0x0191);
+    CHECK(block16(0, REGMAP_BLOCK_SAMPLES) == 2);
+    CHECK(block(0, REGMAP_BLOCK_STATUS) == REGMAP_STATUS_VALID);
+}
+
+static void testClear() {
+    RegMapBegin();
+    RegMapUpdate(0, rom0, true, false, 0x0190, 1000);
+    RegMapUpdate(2, rom1, true, false, 0x1234, 1000);
+    uint16_t seq = sequence();
+
+    RegMapClear(2);
+    for (uint8_t i = 0; i < REGMAP_BLOCK_SIZE; i++) {
+        CHECK(block(2, i) == 0);
+    }
+    CHECK(memcmp(&regMap[REGMAP_ADDR_BLOCKS], rom0, 8) == 0);
+    CHECK(sequence() == seq + 1);
+
+    // A new sensor in the slot starts its counts from scratch.
+    RegMapUpdate(2, rom0, true, false, 0x0010, 2000);
+    CHECK(block16(2, REGMAP_BLOCK_SAMPLES) == 1);
+    CHECK(block(2, REGMAP_BLOCK_STATUS) == REGMAP_STATUS_VALID);
+}
+
+static void testTransport() {
+    RegMapBegin();
+    RegMapUpdate(0, rom0, true, false, 0x0190, 1000);
+
+    RegMapTransportStart(REGMAP_ADDR_ID);
+    CHECK(RegMapTransportRead() == REGMAP_ID);
+    CHECK(RegMapTransportRead() == REGMAP_VERSION);
+    CHECK(RegMapTransportRead() == 1);   // COUNT
+
+    RegMapTransportStart(REGMAP_ADDR_BLOCKS + REGMAP_BLOCK_RAW);
+    CHECK(RegMapTransportRead() == 0x90);
+    CHECK(RegMapTransportRead() == 0x01);
+
+    RegMapTransportStart(REGMAP_SIZE - 1);
+    CHECK(RegMapTransportRead() == 0);
+    CHECK(RegMapTransportRead() == 0xFF); // Past the end
+    CHECK(RegMapTransportRead() == 0xFF);
+}
+
+int main() {
+    testLayout();
+    testEncode();
+    testOutlier();
+    testClear();
+    testTransport();
+    CHECK(lockDepth == 0);
+    CHECK(lockErrors == 0);
+
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("register map: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file trace_replay.c
+ * @brief Host tool: replay a recorded 1-Wire trace ring through OneWireTraceDump.c
+ * @license MIT License
+ * @details Build with `make tools/trace_replay`, then e.g.
+ *
+ *   tools/trace_replay tools/golden/bus.trace       VCD and margins of a stored trace
+ *   make trace-test                                 compare them with tools/golden/bus.vcd
+ *
+ * The trace is the raw ring as the firmware logs it with ONEWIRE_TRACE_RAW set to 1: one
+ * "ticks event level" line per event, oldest first. Lines starting with '#' and the
+ * END TRACE marker are skipped. The events are loaded into the ring the way the slot code
+ * records them, and OneWireTraceDump() writes its log output to stdout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ONEWIRE_TRACE 1
+#define ONEWIRE_TRACE_HOST 1
+#define ONEWIRE_TRACE_DEPTH 64           // As on target, older events fall out of the ring
+#define DELAY_US_TIME 6                  // SysTick ticks per us at 48 MHz, HCLK/8
+
+// The log, straight to stdout.
+static bool LogIdle() { return true; }
+static void LogService() { }
+static void LogPutc(char c) { putchar(c); }
+static void LogPuts(const char *s) { fputs(s, stdout); }
+static void LogPutU32(uint32_t v) { printf("%lu", (unsigned long)v); }
+static void LogPutI32(int32_t v) { printf("%ld", (long)v); }
+
+#include "../OneWire_Trace.h"
+#include "../OneWireTraceDump.c"
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s trace\n", argv[0]);
+        return 2;
+    }
+    FILE *f = fopen(argv[1], "r");
+    if (!f) {
+        perror(argv[1]);
+        return 2;
+    }
+
+    char line[256];
+    unsigned int lineNumber = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long ticks;
+        unsigned int event, level;
+        lineNumber++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == 'E') {
+            continue;
+        }
+        if (sscanf(line, "%lu %u %u", &ticks, &event, &level) != 3
+                || event > ONEWIRE_TRACE_READ_SAMPLE || level > 1) {
+            fprintf(stderr, "%s:%u: bad event: %s", argv[1], lineNumber, line);
+            return 2;
+        }
+        oneWireTraceRecord(ticks, event, level);
+    }
+    fclose(f);
+
+    OneWireTraceDump();
+    return 0;
+}